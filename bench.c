@@ -0,0 +1,212 @@
+#include "bench.h"
+#include "riscv.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What each run reports to the parent */
+typedef struct {
+  Double startup_ns;
+  Double run_ns;
+  Double retired;
+} BenchSample;
+
+static int bench_pipe = -1; /* write end, in the children */
+static Double fork_ns;      /* when the running child was forked */
+static Double start_ns;     /* when it retired its first instruction */
+
+static Double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Double)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sends this run's sample to the parent. Called at exit. */
+static void bench_finish(void) {
+  BenchSample sample;
+
+  sample.startup_ns = start_ns - fork_ns;
+  sample.run_ns = now_ns() - start_ns;
+  sample.retired = retired;
+  if (write(bench_pipe, &sample, sizeof(sample)) != sizeof(sample)) {
+    fprintf(stderr, "Cannot report the benchmark run\n");
+  }
+  close(bench_pipe);
+}
+
+/* Registered last, so it runs before the analysis reports are written and
+ * their cost stays out of the run time */
+void bench_start(void) {
+  atexit(bench_finish);
+  start_ns = now_ns();
+}
+
+/* Forks a run and returns its sample, or exits in the child */
+static int bench_once(BenchSample *sample, long *rss_kb, int *in_child) {
+  struct rusage usage;
+  int fds[2], status, devnull;
+  pid_t pid;
+  ssize_t got;
+
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return -1;
+  }
+  fflush(NULL);
+  fork_ns = now_ns();
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    bench_pipe = fds[1];
+    devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+      dup2(devnull, STDOUT_FILENO);
+      close(devnull);
+    }
+    *in_child = 1;
+    return 0;
+  }
+  close(fds[1]);
+  got = read(fds[0], sample, sizeof(*sample));
+  close(fds[0]);
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    perror("wait4");
+    return -1;
+  }
+  if (got != sizeof(*sample) || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "Benchmark run failed (%s %d)\n",
+            WIFSIGNALED(status) ? "signal" : "status",
+            WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+    return -1;
+  }
+  *rss_kb = usage.ru_maxrss;
+  return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Nearest-rank percentile of sorted values */
+static double percentile(const double *values, int count, int percent) {
+  int rank = (percent * count + 99) / 100;
+
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+/* Middle of sorted values, the mean of the two middle ones if count is
+ * even */
+static double median(const double *values, int count) {
+  return count % 2 ? values[count / 2]
+                   : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static void write_summary(FILE *out, const char *name, double *values,
+                          int count, int last) {
+  qsort(values, count, sizeof(*values), compare_doubles);
+  fprintf(out,
+          "  \"%s\": {\"min\": %.3f, \"p10\": %.3f, \"median\": %.3f, "
+          "\"p90\": %.3f, \"max\": %.3f}%s\n",
+          name, values[0], percentile(values, count, 10),
+          median(values, count), percentile(values, count, 90),
+          values[count - 1], last ? "" : ",");
+}
+
+static void write_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', out);
+    }
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static void write_report(FILE *out, const BenchConfig *config,
+                         const char *program, double *metrics[5],
+                         Double instructions) {
+  fprintf(out, "{\n  \"program\": ");
+  write_string(out, program);
+  fprintf(out,
+          ",\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"budget\": %llu,\n"
+          "  \"instructions\": %llu,\n",
+          config->runs, config->warmup, (unsigned long long)config->budget,
+          (unsigned long long)instructions);
+  write_summary(out, "mips", metrics[0], config->runs, 0);
+  write_summary(out, "ns_per_instruction", metrics[1], config->runs, 0);
+  write_summary(out, "startup_ns", metrics[2], config->runs, 0);
+  write_summary(out, "run_ns", metrics[3], config->runs, 0);
+  write_summary(out, "peak_rss_kb", metrics[4], config->runs, 1);
+  fprintf(out, "}\n");
+}
+
+/* Runs the benchmark. Returns in each child, which goes on to load and run
+ * the program; the parent writes the report and exits without running the
+ * atexit handlers of the analyses it never used. */
+void bench_run(const BenchConfig *config, const char *program) {
+  double *metrics[5];
+  BenchSample sample;
+  Double instructions = 0;
+  long rss_kb;
+  int run, in_child = 0, status = -1, i;
+  FILE *out;
+
+  for (i = 0; i < 5; i++) {
+    metrics[i] = calloc(config->runs, sizeof(double));
+    if (metrics[i] == NULL) {
+      fprintf(stderr, "Out of memory for the benchmark\n");
+      _exit(-1);
+    }
+  }
+  for (run = 0; run < config->warmup + config->runs; run++) {
+    if (bench_once(&sample, &rss_kb, &in_child) != 0) {
+      goto done;
+    }
+    if (in_child) {
+      for (i = 0; i < 5; i++) {
+        free(metrics[i]);
+      }
+      return;
+    }
+    if (run < config->warmup) {
+      continue;
+    }
+    i = run - config->warmup;
+    metrics[0][i] = sample.run_ns ? 1000.0 * sample.retired / sample.run_ns
+                                  : 0.0;
+    metrics[1][i] = sample.retired ? (double)sample.run_ns / sample.retired
+                                   : 0.0;
+    metrics[2][i] = sample.startup_ns;
+    metrics[3][i] = sample.run_ns;
+    metrics[4][i] = rss_kb;
+    instructions = sample.retired;
+  }
+
+  out = config->json ? fopen(config->json, "w") : stdout;
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create benchmark report %s\n", config->json);
+    goto done;
+  }
+  write_report(out, config, program, metrics, instructions);
+  if (out != stdout) {
+    fclose(out);
+  }
+  status = 0;
+done:
+  fflush(NULL);
+  _exit(status);
+}
@@ -0,0 +1,26 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "types.h"
+
+/* Benchmark mode (--bench[=RUNS]). The simulator forks once per run; each
+   child loads and runs the program as usual with its output sent to
+   /dev/null, and at exit reports its startup time (from the fork to the
+   first instruction), run time and instructions retired through a pipe.
+   The parent adds the peak RSS from wait4(), discards the warm-up runs and
+   writes the median and percentiles as JSON. bench_run() returns only in
+   the children; bench_start() marks the end of startup in each of them. */
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUP 2
+
+typedef struct {
+  int runs;         /* measured runs */
+  int warmup;       /* runs discarded before them */
+  Double budget;    /* instructions per run, 0 to run the whole program */
+  const char *json; /* output file, NULL for stdout */
+} BenchConfig;
+
+void bench_run(const BenchConfig *config, const char *program);
+void bench_start(void);
+
+#endif
@@ -0,0 +1,539 @@
+#include "bpred.h"
+#include "riscv.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BPRED_SLOTS (MEMORY_SPACE / 4)
+#define BPRED_MIN_BITS 4
+#define BPRED_MAX_BITS 24
+#define BPRED_MAX_RAS 1024
+#define TAGE_TAG_BITS 9
+#define TAGE_RESET_PERIOD (1 << 18) /* updates between ageing useful bits */
+
+enum { MODEL_STATIC, MODEL_BIMODAL, MODEL_GSHARE, MODEL_TAGE, MODEL_COUNT };
+
+/* One conditional branch in the program */
+typedef struct {
+  Address pc;
+  Double executed;
+  Double taken;
+  Double mispredicts[MODEL_COUNT];
+} BranchSite;
+
+typedef struct {
+  Address pc;
+  Address target;
+  Byte valid;
+} BtbEntry;
+
+static const int tage_history[BPRED_TAGE_TABLES] = {5, 11, 22, 44};
+
+int bpred_enabled;
+
+static int static_predict(Predictor *p, Address pc, Address target);
+static void static_update(Predictor *p, Address pc, int taken);
+static int counters_init(Predictor *p);
+static int bimodal_predict(Predictor *p, Address pc, Address target);
+static void bimodal_update(Predictor *p, Address pc, int taken);
+static int gshare_predict(Predictor *p, Address pc, Address target);
+static void gshare_update(Predictor *p, Address pc, int taken);
+static int tage_init(Predictor *p);
+static int tage_predict(Predictor *p, Address pc, Address target);
+static void tage_update(Predictor *p, Address pc, int taken);
+static void predictor_free(Predictor *p);
+
+static const PredictorOps models[MODEL_COUNT] = {
+    {"static", NULL, static_predict, static_update, NULL},
+    {"bimodal", counters_init, bimodal_predict, bimodal_update,
+     predictor_free},
+    {"gshare", counters_init, gshare_predict, gshare_update, predictor_free},
+    {"tage", tage_init, tage_predict, tage_update, predictor_free},
+};
+
+static int model_bits[MODEL_COUNT] = {0, 12, 12, 10};
+static int btb_bits = 9;
+static int ras_depth = 16;
+
+static Predictor predictors[MODEL_COUNT];
+static char *bpred_filename;
+static const Byte *bpred_memory;
+static Word *site_index; /* per pc, 1 + its index in sites, 0 for none */
+static BranchSite *sites;
+static Word site_count, site_capacity;
+static Double branches, taken_branches, jumps;
+static BtbEntry *btb;
+static Double btb_lookups, btb_misses;
+static Address *ras;
+static int ras_top, ras_count;
+static Double returns, ras_misses;
+
+/* Static: backward branches (loops) are taken, forward ones are not */
+static int static_predict(Predictor *p, Address pc, Address target) {
+  return target < pc;
+}
+
+static void static_update(Predictor *p, Address pc, int taken) {}
+
+static int counters_init(Predictor *p) {
+  p->counters = malloc((size_t)1 << p->bits);
+  if (p->counters == NULL) {
+    return -1;
+  }
+  memset(p->counters, 1, (size_t)1 << p->bits); /* weakly not taken */
+  return 0;
+}
+
+static void count(Byte *counter, int taken, int max) {
+  if (taken && *counter < max) {
+    (*counter)++;
+  } else if (!taken && *counter > 0) {
+    (*counter)--;
+  }
+}
+
+static Word bimodal_index(const Predictor *p, Address pc) {
+  return (pc >> 2) & ((1U << p->bits) - 1);
+}
+
+static int bimodal_predict(Predictor *p, Address pc, Address target) {
+  return p->counters[bimodal_index(p, pc)] >= 2;
+}
+
+static void bimodal_update(Predictor *p, Address pc, int taken) {
+  count(&p->counters[bimodal_index(p, pc)], taken, 3);
+}
+
+static Word gshare_index(const Predictor *p, Address pc) {
+  return ((pc >> 2) ^ (Word)p->history) & ((1U << p->bits) - 1);
+}
+
+static int gshare_predict(Predictor *p, Address pc, Address target) {
+  return p->counters[gshare_index(p, pc)] >= 2;
+}
+
+static void gshare_update(Predictor *p, Address pc, int taken) {
+  count(&p->counters[gshare_index(p, pc)], taken, 3);
+  p->history = p->history << 1 | taken;
+}
+
+/* log2 of the entries in each tagged table, a quarter of the base */
+static int tage_bits(const Predictor *p) {
+  return p->bits > BPRED_MIN_BITS + 2 ? p->bits - 2 : BPRED_MIN_BITS;
+}
+
+/* TAGE: a bimodal base predictor and tagged tables indexed with
+ * geometrically longer global histories. The longest history whose tag
+ * matches makes the prediction. */
+static int tage_init(Predictor *p) {
+  size_t size = (size_t)1 << tage_bits(p);
+  TageTable *table;
+  int t;
+
+  if (counters_init(p) != 0) {
+    return -1;
+  }
+  for (t = 0; t < BPRED_TAGE_TABLES; t++) {
+    table = &p->tables[t];
+    table->history = tage_history[t];
+    table->counters = malloc(size);
+    table->useful = calloc(size, 1);
+    table->tags = malloc(size * sizeof(*table->tags));
+    if (table->counters == NULL || table->useful == NULL ||
+        table->tags == NULL) {
+      return -1;
+    }
+    memset(table->counters, 4, size);
+    memset(table->tags, 0xff, size * sizeof(*table->tags)); /* no tag */
+  }
+  return 0;
+}
+
+/* The newest length bits of history folded down to bits bits */
+static Word fold(Double history, int length, int bits) {
+  Word folded = 0;
+
+  history &= ((Double)1 << length) - 1;
+  while (history) {
+    folded ^= history & ((1U << bits) - 1);
+    history >>= bits;
+  }
+  return folded;
+}
+
+static Word tage_index(const Predictor *p, int t, Address pc) {
+  int bits = tage_bits(p);
+  Word word = pc >> 2;
+
+  return (word ^ word >> bits ^ fold(p->history, p->tables[t].history, bits)) &
+         ((1U << bits) - 1);
+}
+
+static Half tage_tag(const Predictor *p, int t, Address pc) {
+  int length = p->tables[t].history;
+
+  return ((pc >> 2) ^ fold(p->history, length, TAGE_TAG_BITS) ^
+          fold(p->history, length, TAGE_TAG_BITS - 1) << 1) &
+         ((1U << TAGE_TAG_BITS) - 1);
+}
+
+static int tage_predict(Predictor *p, Address pc, Address target) {
+  int t, prediction = p->counters[bimodal_index(p, pc)] >= 2;
+  TageTable *table;
+  Word i;
+
+  p->provider = -1;
+  p->alternate = prediction;
+  for (t = 0; t < BPRED_TAGE_TABLES; t++) {
+    table = &p->tables[t];
+    i = tage_index(p, t, pc);
+    if (table->tags[i] == tage_tag(p, t, pc)) {
+      p->alternate = prediction;
+      prediction = table->counters[i] >= 4;
+      p->provider = t;
+    }
+  }
+  p->predicted = prediction;
+  return prediction;
+}
+
+static void tage_update(Predictor *p, Address pc, int taken) {
+  TageTable *table;
+  Word i, size = 1U << tage_bits(p);
+  int t, allocated = 0;
+
+  if (p->provider < 0) {
+    count(&p->counters[bimodal_index(p, pc)], taken, 3);
+  } else {
+    table = &p->tables[p->provider];
+    i = tage_index(p, p->provider, pc);
+    count(&table->counters[i], taken, 7);
+    if (p->predicted != p->alternate) {
+      count(&table->useful[i], p->predicted == taken, 3);
+    }
+  }
+
+  /* on a misprediction, claim an entry with a longer history */
+  if (p->predicted != taken) {
+    for (t = p->provider + 1; t < BPRED_TAGE_TABLES && !allocated; t++) {
+      table = &p->tables[t];
+      i = tage_index(p, t, pc);
+      if (table->useful[i] == 0) {
+        table->tags[i] = tage_tag(p, t, pc);
+        table->counters[i] = taken ? 4 : 3;
+        allocated = 1;
+      }
+    }
+    for (t = p->provider + 1; t < BPRED_TAGE_TABLES && !allocated; t++) {
+      count(&p->tables[t].useful[tage_index(p, t, pc)], 0, 3);
+    }
+  }
+
+  if (++p->clock % TAGE_RESET_PERIOD == 0) {
+    for (t = 0; t < BPRED_TAGE_TABLES; t++) {
+      for (i = 0; i < size; i++) {
+        p->tables[t].useful[i] >>= 1;
+      }
+    }
+  }
+  p->history = p->history << 1 | taken;
+}
+
+static void predictor_free(Predictor *p) {
+  int t;
+
+  free(p->counters);
+  for (t = 0; t < BPRED_TAGE_TABLES; t++) {
+    free(p->tables[t].counters);
+    free(p->tables[t].useful);
+    free(p->tables[t].tags);
+  }
+}
+
+/* Parses NAME:SIZE, such as gshare:14 or ras:32. Returns 0 on success. */
+int bpred_configure(const char *arg) {
+  const char *colon = strchr(arg, ':');
+  char *end;
+  long size;
+  int m;
+
+  if (colon == NULL) {
+    return -1;
+  }
+  size = strtol(colon + 1, &end, 0);
+  if (end == colon + 1 || *end != '\0') {
+    return -1;
+  }
+  if (strncmp(arg, "ras:", 4) == 0) {
+    if (size < 1 || size > BPRED_MAX_RAS) {
+      return -1;
+    }
+    ras_depth = size;
+    return 0;
+  }
+  if (size < BPRED_MIN_BITS || size > BPRED_MAX_BITS) {
+    return -1;
+  }
+  if (strncmp(arg, "btb:", 4) == 0) {
+    btb_bits = size;
+    return 0;
+  }
+  for (m = MODEL_BIMODAL; m < MODEL_COUNT; m++) {
+    if (strlen(models[m].name) == (size_t)(colon - arg) &&
+        strncmp(arg, models[m].name, colon - arg) == 0) {
+      model_bits[m] = size;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Starts the models with the configured sizes. Returns 0 on success. */
+int bpred_open(const char *filename, const Byte *memory) {
+  static int registered;
+  int m;
+
+  for (m = 0; m < MODEL_COUNT; m++) {
+    memset(&predictors[m], 0, sizeof(predictors[m]));
+    predictors[m].ops = &models[m];
+    predictors[m].bits = model_bits[m];
+    if (models[m].init && models[m].init(&predictors[m]) != 0) {
+      fprintf(stderr, "Out of memory for the %s predictor\n", models[m].name);
+      return -1;
+    }
+  }
+  bpred_filename = strdup(filename);
+  site_index = calloc(BPRED_SLOTS, sizeof(*site_index));
+  btb = calloc((size_t)1 << btb_bits, sizeof(*btb));
+  ras = calloc(ras_depth, sizeof(*ras));
+  if (bpred_filename == NULL || site_index == NULL || btb == NULL ||
+      ras == NULL) {
+    fprintf(stderr, "Out of memory for branch prediction\n");
+    return -1;
+  }
+  bpred_memory = memory;
+  bpred_enabled = 1;
+  if (!registered) {
+    atexit(bpred_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+static BranchSite *find_site(Address pc) {
+  static BranchSite unmapped;
+  Word *index;
+
+  if (pc >= MEMORY_SPACE) {
+    return &unmapped;
+  }
+  index = &site_index[pc >> 2];
+  if (*index == 0) {
+    if (site_count == site_capacity) {
+      site_capacity = site_capacity ? 2 * site_capacity : 256;
+      sites = realloc(sites, site_capacity * sizeof(*sites));
+      if (sites == NULL) {
+        fprintf(stderr, "Out of memory for branch prediction\n");
+        exit(-1);
+      }
+    }
+    memset(&sites[site_count], 0, sizeof(*sites));
+    sites[site_count].pc = pc;
+    *index = ++site_count;
+  }
+  return &sites[*index - 1];
+}
+
+/* Looks up a taken control transfer in the branch target buffer */
+static void btb_lookup(Address pc, Address target) {
+  BtbEntry *entry = &btb[(pc >> 2) & ((1U << btb_bits) - 1)];
+
+  btb_lookups++;
+  if (!entry->valid || entry->pc != pc || entry->target != target) {
+    btb_misses++;
+    entry->pc = pc;
+    entry->target = target;
+    entry->valid = 1;
+  }
+}
+
+static int is_link(int reg) { return reg == 1 || reg == 5; }
+
+static void ras_push(Address address) {
+  ras_top = (ras_top + 1) % ras_depth;
+  ras[ras_top] = address;
+  if (ras_count < ras_depth) {
+    ras_count++;
+  }
+}
+
+/* Records a conditional branch at pc to target */
+void bpred_branch(Address pc, Address target, int taken) {
+  BranchSite *site = find_site(pc);
+  Predictor *p;
+  int m;
+
+  branches++;
+  taken_branches += taken;
+  site->executed++;
+  site->taken += taken;
+  for (m = 0; m < MODEL_COUNT; m++) {
+    p = &predictors[m];
+    if (p->ops->predict(p, pc, target) != taken) {
+      p->mispredicts++;
+      site->mispredicts[m]++;
+    }
+    p->ops->update(p, pc, taken);
+  }
+  if (taken) {
+    btb_lookup(pc, target);
+  }
+}
+
+/* Records a jal at pc to target */
+void bpred_jump(Address pc, Address target, int rd) {
+  jumps++;
+  btb_lookup(pc, target);
+  if (is_link(rd)) {
+    ras_push(pc + 4);
+  }
+}
+
+/* Records a jalr at pc to target. A jalr x0 through a link register is a
+ * return and is predicted by the return-address stack. */
+void bpred_indirect(Address pc, Address target, int rd, int rs1) {
+  jumps++;
+  if (rd == 0 && is_link(rs1)) {
+    returns++;
+    if (ras_count == 0 || ras[ras_top] != target) {
+      ras_misses++;
+    }
+    if (ras_count > 0) {
+      ras_top = (ras_top + ras_depth - 1) % ras_depth;
+      ras_count--;
+    }
+  } else {
+    btb_lookup(pc, target);
+  }
+  if (is_link(rd)) {
+    ras_push(pc + 4);
+  }
+}
+
+static double percent(Double part, Double whole) {
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static double mpki(Double mispredicts) {
+  return retired ? 1000.0 * mispredicts / retired : 0.0;
+}
+
+static Double site_mispredicts(const BranchSite *site) {
+  Double total = 0;
+  int m;
+
+  for (m = 0; m < MODEL_COUNT; m++) {
+    total += site->mispredicts[m];
+  }
+  return total;
+}
+
+static int compare_sites(const void *a, const void *b) {
+  Double x = site_mispredicts(a), y = site_mispredicts(b);
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void write_report(FILE *out) {
+  char line[DISASM_LINE_MAX];
+  const BranchSite *site;
+  Word i, bits;
+  int m;
+
+  fprintf(out,
+          "%llu instructions, %llu conditional branches (%.2f%% taken), "
+          "%llu jumps\n\n",
+          (unsigned long long)retired, (unsigned long long)branches,
+          percent(taken_branches, branches), (unsigned long long)jumps);
+  fprintf(out, "%-8s %8s %14s %7s %8s\n", "model", "entries", "mispredicts",
+          "rate", "MPKI");
+  for (m = 0; m < MODEL_COUNT; m++) {
+    if (m == MODEL_STATIC) {
+      fprintf(out, "%-8s %8s", models[m].name, "-");
+    } else {
+      fprintf(out, "%-8s %8u", models[m].name, 1U << predictors[m].bits);
+    }
+    fprintf(out, " %14llu %6.2f%% %8.3f\n",
+            (unsigned long long)predictors[m].mispredicts,
+            percent(predictors[m].mispredicts, branches),
+            mpki(predictors[m].mispredicts));
+  }
+  fprintf(out, "%-8s %8u %14llu %6.2f%% %8.3f  (of %llu taken transfers)\n",
+          "btb", 1U << btb_bits, (unsigned long long)btb_misses,
+          percent(btb_misses, btb_lookups), mpki(btb_misses),
+          (unsigned long long)btb_lookups);
+  fprintf(out, "%-8s %8d %14llu %6.2f%% %8.3f  (of %llu returns)\n", "ras",
+          ras_depth, (unsigned long long)ras_misses,
+          percent(ras_misses, returns), mpki(ras_misses),
+          (unsigned long long)returns);
+
+  qsort(sites, site_count, sizeof(*sites), compare_sites);
+  fprintf(out, "\nMispredictions by branch\n");
+  fprintf(out, "%14s %7s", "executed", "taken");
+  for (m = 0; m < MODEL_COUNT; m++) {
+    fprintf(out, " %8s", models[m].name);
+  }
+  fprintf(out, "  instruction\n");
+  for (i = 0; i < site_count && i < BPRED_TOP_PCS; i++) {
+    site = &sites[i];
+    fprintf(out, "%14llu %6.2f%%", (unsigned long long)site->executed,
+            percent(site->taken, site->executed));
+    for (m = 0; m < MODEL_COUNT; m++) {
+      fprintf(out, " %7.2f%%", percent(site->mispredicts[m], site->executed));
+    }
+    memcpy(&bits, bpred_memory + site->pc, sizeof(bits));
+    if (is_known_opcode(bits & 0x7f)) {
+      format_instruction(line, sizeof(line), bits);
+    } else {
+      strcpy(line, "(overwritten)\n");
+    }
+    fprintf(out, "  %08x: %08x  %s", site->pc, bits, line);
+  }
+}
+
+/* Writes the report. Called at exit. */
+void bpred_close(void) {
+  FILE *out;
+  int m;
+
+  if (site_index == NULL) {
+    return;
+  }
+  bpred_enabled = 0;
+  out = fopen(bpred_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create branch prediction report %s\n",
+            bpred_filename);
+  } else {
+    write_report(out);
+    fclose(out);
+  }
+
+  for (m = 0; m < MODEL_COUNT; m++) {
+    if (models[m].free) {
+      models[m].free(&predictors[m]);
+    }
+  }
+  free(site_index);
+  free(sites);
+  free(btb);
+  free(ras);
+  free(bpred_filename);
+  site_index = NULL;
+  sites = NULL;
+  btb = NULL;
+  ras = NULL;
+  bpred_filename = NULL;
+  site_count = site_capacity = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include "types.h"
+
+/* Branch predictor models (--bpred=FILE). The branch and jump handlers in
+   part2.c report every control transfer, and each direction predictor
+   guesses every conditional branch side by side: static (backward taken,
+   forward not taken), bimodal, gshare and a small TAGE. Taken branches and
+   jumps also look up a branch target buffer, and returns are checked
+   against a return-address stack. Table sizes are set with
+   --bpred-config=NAME:SIZE, SIZE being log2 of the entries or, for the
+   ras, its depth. At exit FILE gets mispredictions and MPKI for each model
+   and the branches mispredicted most. */
+#define BPRED_TOP_PCS 40
+#define BPRED_TAGE_TABLES 4
+
+typedef struct Predictor Predictor;
+
+/* A direction predictor. predict() guesses whether the conditional branch
+   at pc to target is taken and update() tells it the outcome. */
+typedef struct {
+  const char *name;
+  int (*init)(Predictor *predictor);
+  int (*predict)(Predictor *predictor, Address pc, Address target);
+  void (*update)(Predictor *predictor, Address pc, int taken);
+  void (*free)(Predictor *predictor);
+} PredictorOps;
+
+typedef struct {
+  Byte *counters; /* signed 3-bit prediction counters, as bytes */
+  Byte *useful;
+  Half *tags;
+  int history; /* history bits used */
+} TageTable;
+
+struct Predictor {
+  const PredictorOps *ops;
+  int bits;       /* log2 of the table entries */
+  Byte *counters; /* 2-bit saturating counters */
+  Double history; /* global history, newest outcome in bit 0 */
+  TageTable tables[BPRED_TAGE_TABLES];
+  int provider;  /* table that made the last TAGE prediction, -1 for base */
+  int predicted; /* the last prediction */
+  int alternate; /* what the next shorter history would have predicted */
+  Double clock; /* TAGE updates, for ageing the useful bits */
+  Double mispredicts;
+};
+
+extern int bpred_enabled;
+
+int bpred_configure(const char *arg);
+int bpred_open(const char *filename, const Byte *memory);
+void bpred_branch(Address pc, Address target, int taken);
+void bpred_jump(Address pc, Address target, int rd);
+void bpred_indirect(Address pc, Address target, int rd, int rs1);
+void bpred_close(void);
+
+#endif
@@ -0,0 +1,384 @@
+#include "cache.h"
+#include "riscv.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_SLOTS (MEMORY_SPACE / 4)
+#define CACHE_INVALID 0xffffffff /* no line number reaches this */
+
+typedef struct {
+  CacheConfig config;
+  Word sets;
+  Word line_bits;
+  Word *lines;    /* line number held by each way, sets * ways */
+  Double *stamps; /* last use (LRU) or fill (FIFO) of each way */
+  Byte *dirty;
+  Double clock;
+  Double accesses;
+  Double misses;
+  Double writebacks;
+} Cache;
+
+/* What the instruction at one pc did to the hierarchy */
+typedef struct {
+  Double fetches;
+  Double fetch_misses; /* in L1I */
+  Double data;         /* lines loaded or stored */
+  Double data_misses;  /* in L1D */
+  Double l2_misses;
+} CacheSlot;
+
+static const char *const level_names[CACHE_LEVELS] = {"l1i", "l1d", "l2"};
+static const char *const policy_names[] = {"lru", "fifo", "random"};
+
+int cache_enabled;
+
+static CacheConfig configs[CACHE_LEVELS] = {
+    {8 * 1024, 2, 32, CACHE_LRU},
+    {8 * 1024, 4, 32, CACHE_LRU},
+    {64 * 1024, 8, 64, CACHE_LRU},
+};
+static Cache caches[CACHE_LEVELS];
+static char *cache_filename;
+static const Byte *cache_memory;
+static CacheSlot *cache_slots;
+static CacheSlot *current; /* the slot of the instruction being executed */
+static CacheSlot unmapped; /* for pcs outside memory */
+static Word random_state = 0x2545f491;
+
+static int is_power_of_two(Word n) { return n && !(n & (n - 1)); }
+
+/* Parses a number with an optional k or M suffix */
+static int parse_number(const char *arg, char **end, Word *value) {
+  unsigned long n = strtoul(arg, end, 0);
+
+  if (*end == arg) {
+    return -1;
+  }
+  if (**end == 'k' || **end == 'K') {
+    n <<= 10;
+    (*end)++;
+  } else if (**end == 'm' || **end == 'M') {
+    n <<= 20;
+    (*end)++;
+  }
+  *value = n;
+  return 0;
+}
+
+/* Parses LEVEL:SIZE[:WAYS[:LINE[:POLICY]]], such as l1d:16k:4:32:fifo.
+ * Fields that are left out keep their defaults. Returns 0 on success. */
+int cache_configure(const char *arg) {
+  CacheConfig config;
+  const char *colon = strchr(arg, ':');
+  char *end;
+  int level, policy;
+
+  if (colon == NULL) {
+    return -1;
+  }
+  for (level = 0; level < CACHE_LEVELS; level++) {
+    if (strlen(level_names[level]) == (size_t)(colon - arg) &&
+        strncmp(arg, level_names[level], colon - arg) == 0) {
+      break;
+    }
+  }
+  if (level == CACHE_LEVELS) {
+    return -1;
+  }
+  config = configs[level];
+  if (parse_number(colon + 1, &end, &config.size) != 0) {
+    return -1;
+  }
+  if (*end == ':' && parse_number(end + 1, &end, &config.ways) != 0) {
+    return -1;
+  }
+  if (*end == ':' && parse_number(end + 1, &end, &config.line) != 0) {
+    return -1;
+  }
+  if (*end == ':') {
+    for (policy = 0; policy <= CACHE_RANDOM; policy++) {
+      if (strcmp(end + 1, policy_names[policy]) == 0) {
+        break;
+      }
+    }
+    if (policy > CACHE_RANDOM) {
+      return -1;
+    }
+    config.policy = policy;
+    end += strlen(end);
+  }
+  if (*end != '\0') {
+    return -1;
+  }
+  configs[level] = config;
+  return 0;
+}
+
+static int cache_init(Cache *cache, const CacheConfig *config,
+                      const char *name) {
+  Word ways;
+
+  memset(cache, 0, sizeof(*cache));
+  cache->config = *config;
+  if (config->size == 0) {
+    return 0;
+  }
+  if (!is_power_of_two(config->line) || config->line < 4 ||
+      config->ways == 0 || config->size % (config->ways * config->line) ||
+      !is_power_of_two(config->size / (config->ways * config->line))) {
+    fprintf(stderr,
+            "Bad %s cache: the line size and number of sets must be powers "
+            "of two\n",
+            name);
+    return -1;
+  }
+  cache->sets = config->size / (config->ways * config->line);
+  while ((1U << cache->line_bits) < config->line) {
+    cache->line_bits++;
+  }
+  ways = cache->sets * config->ways;
+  cache->lines = malloc(ways * sizeof(*cache->lines));
+  cache->stamps = calloc(ways, sizeof(*cache->stamps));
+  cache->dirty = calloc(ways, sizeof(*cache->dirty));
+  if (cache->lines == NULL || cache->stamps == NULL || cache->dirty == NULL) {
+    fprintf(stderr, "Out of memory for the %s cache\n", name);
+    return -1;
+  }
+  memset(cache->lines, 0xff, ways * sizeof(*cache->lines));
+  return 0;
+}
+
+/* Starts the model with the configured levels. Returns 0 on success. */
+int cache_open(const char *filename, const Byte *memory) {
+  static int registered;
+  int level;
+
+  for (level = 0; level < CACHE_LEVELS; level++) {
+    if (cache_init(&caches[level], &configs[level], level_names[level]) != 0) {
+      return -1;
+    }
+  }
+  if (configs[CACHE_L2].size &&
+      (configs[CACHE_L2].line < configs[CACHE_L1I].line ||
+       configs[CACHE_L2].line < configs[CACHE_L1D].line)) {
+    fprintf(stderr, "The l2 cache line must be at least as long as the l1 "
+                    "lines\n");
+    return -1;
+  }
+  cache_filename = strdup(filename);
+  cache_slots = calloc(CACHE_SLOTS, sizeof(*cache_slots));
+  if (cache_filename == NULL || cache_slots == NULL) {
+    fprintf(stderr, "Out of memory for the cache model\n");
+    return -1;
+  }
+  cache_memory = memory;
+  current = &unmapped;
+  cache_enabled = 1;
+  if (!registered) {
+    atexit(cache_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+static Word choose_victim(Cache *cache, Word first) {
+  Word way, victim = 0;
+
+  if (cache->config.policy == CACHE_RANDOM) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % cache->config.ways;
+  }
+  for (way = 1; way < cache->config.ways; way++) {
+    if (cache->stamps[first + way] < cache->stamps[first + victim]) {
+      victim = way;
+    }
+  }
+  return victim;
+}
+
+/* Looks up the line holding address, filling it on a miss. A dirty line
+ * evicted from an L1 is written back to L2. Returns 1 on a hit. */
+static int cache_access(Cache *cache, Address address, int write) {
+  Word line = address >> cache->line_bits;
+  Word first = (line & (cache->sets - 1)) * cache->config.ways;
+  Word way, i;
+
+  cache->accesses++;
+  cache->clock++;
+  for (way = 0; way < cache->config.ways; way++) {
+    i = first + way;
+    if (cache->lines[i] == line) {
+      if (cache->config.policy == CACHE_LRU) {
+        cache->stamps[i] = cache->clock;
+      }
+      cache->dirty[i] |= write;
+      return 1;
+    }
+  }
+
+  cache->misses++;
+  for (way = 0; way < cache->config.ways; way++) {
+    if (cache->lines[first + way] == CACHE_INVALID) {
+      break;
+    }
+  }
+  if (way == cache->config.ways) {
+    way = choose_victim(cache, first);
+  }
+  i = first + way;
+  if (cache->lines[i] != CACHE_INVALID && cache->dirty[i]) {
+    cache->writebacks++;
+    if (cache != &caches[CACHE_L2] && caches[CACHE_L2].config.size) {
+      cache_access(&caches[CACHE_L2], cache->lines[i] << cache->line_bits, 1);
+    }
+  }
+  cache->lines[i] = line;
+  cache->stamps[i] = cache->clock;
+  cache->dirty[i] = write;
+  return 0;
+}
+
+/* Sends one access through an L1 and on to L2 if it misses. Returns 1 if
+ * the L1 hit. */
+static int hierarchy_access(Cache *l1, Address address, int write) {
+  if (l1->config.size && cache_access(l1, address, write)) {
+    return 1;
+  }
+  if (caches[CACHE_L2].config.size &&
+      !cache_access(&caches[CACHE_L2], address, l1->config.size ? 0 : write)) {
+    current->l2_misses++;
+  }
+  return 0;
+}
+
+/* Records the fetch of the instruction at pc, which the data accesses that
+ * follow are charged to */
+void cache_fetch(Address pc) {
+  current = pc < MEMORY_SPACE ? &cache_slots[pc >> 2] : &unmapped;
+  current->fetches++;
+  if (!hierarchy_access(&caches[CACHE_L1I], pc, 0)) {
+    current->fetch_misses++;
+  }
+}
+
+/* Records a load or store of size bytes, one access per line it touches */
+void cache_data(Address address, Word size, int write) {
+  Word line_bits = caches[CACHE_L1D].config.size
+                       ? caches[CACHE_L1D].line_bits
+                       : caches[CACHE_L2].line_bits;
+  Address line, last = (address + size - 1) >> line_bits;
+
+  for (line = address >> line_bits; line <= last; line++) {
+    current->data++;
+    if (!hierarchy_access(&caches[CACHE_L1D], line << line_bits, write)) {
+      current->data_misses++;
+    }
+  }
+}
+
+static Double slot_misses(Word slot) {
+  return cache_slots[slot].fetch_misses + cache_slots[slot].data_misses +
+         cache_slots[slot].l2_misses;
+}
+
+static int compare_slots(const void *a, const void *b) {
+  Double x = slot_misses(*(const Word *)a);
+  Double y = slot_misses(*(const Word *)b);
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static double percent(Double part, Double whole) {
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void write_report(FILE *out) {
+  char line[DISASM_LINE_MAX];
+  const Cache *cache;
+  const CacheSlot *s;
+  Word *slots, count = 0, slot, bits, i;
+  int level;
+
+  fprintf(out, "%-5s %8s %5s %5s %-7s %14s %14s %7s %14s\n", "level",
+          "size", "ways", "line", "policy", "accesses", "misses", "miss%",
+          "writebacks");
+  for (level = 0; level < CACHE_LEVELS; level++) {
+    cache = &caches[level];
+    if (cache->config.size == 0) {
+      fprintf(out, "%-5s %8s\n", level_names[level], "off");
+      continue;
+    }
+    fprintf(out, "%-5s %8u %5u %5u %-7s %14llu %14llu %6.2f%% %14llu\n",
+            level_names[level], cache->config.size, cache->config.ways,
+            cache->config.line, policy_names[cache->config.policy],
+            (unsigned long long)cache->accesses,
+            (unsigned long long)cache->misses,
+            percent(cache->misses, cache->accesses),
+            (unsigned long long)cache->writebacks);
+  }
+
+  slots = malloc(CACHE_SLOTS * sizeof(*slots));
+  if (slots == NULL) {
+    fprintf(stderr, "Out of memory for the cache report\n");
+    exit(-1);
+  }
+  for (slot = 0; slot < CACHE_SLOTS; slot++) {
+    if (slot_misses(slot)) {
+      slots[count++] = slot;
+    }
+  }
+  qsort(slots, count, sizeof(*slots), compare_slots);
+
+  fprintf(out, "\nMisses by instruction\n");
+  fprintf(out, "%14s %7s %14s %7s %14s  instruction\n", "fetches", "l1i%",
+          "data", "l1d%", "l2 misses");
+  for (i = 0; i < count && i < CACHE_TOP_PCS; i++) {
+    s = &cache_slots[slots[i]];
+    memcpy(&bits, cache_memory + 4 * slots[i], sizeof(bits));
+    if (is_known_opcode(bits & 0x7f)) {
+      format_instruction(line, sizeof(line), bits);
+    } else {
+      strcpy(line, "(overwritten)\n");
+    }
+    fprintf(out, "%14llu %6.2f%% %14llu %6.2f%% %14llu  %08x: %08x  %s",
+            (unsigned long long)s->fetches,
+            percent(s->fetch_misses, s->fetches),
+            (unsigned long long)s->data, percent(s->data_misses, s->data),
+            (unsigned long long)s->l2_misses, 4 * slots[i], bits, line);
+  }
+  free(slots);
+}
+
+/* Writes the report. Called at exit. */
+void cache_close(void) {
+  FILE *out;
+  int level;
+
+  if (cache_slots == NULL) {
+    return;
+  }
+  cache_enabled = 0;
+  out = fopen(cache_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create cache report %s\n", cache_filename);
+  } else {
+    write_report(out);
+    fclose(out);
+  }
+
+  for (level = 0; level < CACHE_LEVELS; level++) {
+    free(caches[level].lines);
+    free(caches[level].stamps);
+    free(caches[level].dirty);
+  }
+  memset(caches, 0, sizeof(caches));
+  free(cache_slots);
+  free(cache_filename);
+  cache_slots = NULL;
+  cache_filename = NULL;
+}
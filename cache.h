@@ -0,0 +1,37 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+
+/* Cache hierarchy model (--cache=FILE). Instruction fetches go through L1I
+   and loads and stores through L1D; misses in either, and dirty lines they
+   evict, go to a unified L2. Caches are write-back and write-allocate. Each
+   level is set with --cache-config=LEVEL:SIZE[:WAYS[:LINE[:POLICY]]], and a
+   size of 0 leaves the level out. At exit FILE gets hit and miss rates per
+   level and the instructions that missed most.
+
+   The model only tracks tags, so it does not change what the program does.
+   When it is off, fetch(), load() and store() test cache_enabled and do
+   nothing else. */
+#define CACHE_TOP_PCS 40
+
+typedef enum { CACHE_L1I, CACHE_L1D, CACHE_L2, CACHE_LEVELS } CacheLevel;
+
+typedef enum { CACHE_LRU, CACHE_FIFO, CACHE_RANDOM } CachePolicy;
+
+typedef struct {
+  Word size; /* bytes, 0 if the level is left out */
+  Word ways;
+  Word line; /* bytes */
+  CachePolicy policy;
+} CacheConfig;
+
+extern int cache_enabled;
+
+int cache_configure(const char *arg);
+int cache_open(const char *filename, const Byte *memory);
+void cache_fetch(Address pc);
+void cache_data(Address address, Word size, int write);
+void cache_close(void);
+
+#endif
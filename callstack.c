@@ -0,0 +1,110 @@
+#include "callstack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void callstack_init(CallStack *stack, Address entry) {
+  memset(stack, 0, sizeof(*stack));
+  stack->root.function = entry;
+  stack->root.calls = 1;
+  stack->current = &stack->root;
+}
+
+/* Visits the tree in depth-first order; returns NULL after the last node.
+ * Start from &stack->root. */
+CallNode *callstack_next(CallNode *node) {
+  if (node->child) {
+    return node->child;
+  }
+  while (node && !node->sibling) {
+    node = node->parent;
+  }
+  return node ? node->sibling : NULL;
+}
+
+/* Sets total in every node to its own instructions plus those of its
+ * callees */
+void callstack_totals(CallStack *stack) {
+  CallNode *node;
+
+  for (node = &stack->root; node; node = callstack_next(node)) {
+    node->total = node->self;
+  }
+  /* add each node to its parent after all of its children, without
+   * recursion */
+  node = &stack->root;
+  while (node->child) {
+    node = node->child;
+  }
+  while (node != &stack->root) {
+    node->parent->total += node->total;
+    if (node->sibling) {
+      node = node->sibling;
+      while (node->child) {
+        node = node->child;
+      }
+    } else {
+      node = node->parent;
+    }
+  }
+}
+
+void callstack_free(CallStack *stack) {
+  CallNode *node = stack->root.child, *next;
+
+  /* free children before their parents, without recursion */
+  while (node && node != &stack->root) {
+    if (node->child) {
+      node = node->child;
+      continue;
+    }
+    next = node->sibling ? node->sibling : node->parent;
+    if (node->parent) {
+      node->parent->child = node->sibling;
+    }
+    free(node);
+    node = next;
+  }
+  stack->root.child = NULL;
+  stack->current = &stack->root;
+}
+
+void callstack_call(CallStack *stack, Address call_site, Address callee) {
+  CallNode *parent = stack->current, *node, **link;
+
+  if (stack->depth >= CALLSTACK_MAX_DEPTH) {
+    stack->overflow++;
+    return;
+  }
+  /* find the callee among the known ones and move it to the front */
+  for (link = &parent->child; (node = *link) != NULL; link = &node->sibling) {
+    if (node->function == callee) {
+      *link = node->sibling;
+      break;
+    }
+  }
+  if (node == NULL) {
+    node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+      fprintf(stderr, "Out of memory tracking calls\n");
+      exit(-1);
+    }
+    node->function = callee;
+    node->call_site = call_site;
+    node->parent = parent;
+  }
+  node->sibling = parent->child;
+  parent->child = node;
+  node->calls++;
+  stack->current = node;
+  stack->depth++;
+}
+
+void callstack_return(CallStack *stack) {
+  if (stack->overflow) {
+    stack->overflow--;
+  } else if (stack->current->parent) {
+    stack->current = stack->current->parent;
+    stack->depth--;
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef CALLSTACK_H
+#define CALLSTACK_H
+
+#include "types.h"
+
+/* Guest call tracking for the profilers. Calls are jal/jalr that link a
+   register, returns are jalr x0, 0(ra). The stack is kept as a calling
+   context tree with one node per distinct chain of called functions, so
+   that costs are charged to the current node with a single increment. */
+#define CALLSTACK_MAX_DEPTH 1024
+
+typedef enum {
+  CALL_NONE,
+  CALL_CALL,
+  CALL_RETURN,
+} CallKind;
+
+typedef struct CallNode {
+  Address function;  /* entry address of the function */
+  Address call_site; /* address of the first call that entered it */
+  struct CallNode *parent;
+  struct CallNode *child;   /* first callee */
+  struct CallNode *sibling; /* next callee of parent */
+  Double self;  /* instructions retired in this context */
+  Double calls; /* times this context was entered */
+  Double total; /* self plus callees, see callstack_totals() */
+} CallNode;
+
+typedef struct {
+  CallNode root;
+  CallNode *current;
+  Word depth;    /* of current below root */
+  Word overflow; /* calls deeper than CALLSTACK_MAX_DEPTH not yet returned */
+} CallStack;
+
+void callstack_init(CallStack *stack, Address entry);
+void callstack_free(CallStack *stack);
+void callstack_call(CallStack *stack, Address call_site, Address callee);
+void callstack_return(CallStack *stack);
+CallNode *callstack_next(CallNode *node);
+void callstack_totals(CallStack *stack);
+
+/* Classifies a retired instruction */
+static inline CallKind callstack_kind(Word bits) {
+  Word opcode = bits & 0x7f, rd = (bits >> 7) & 0x1f, rs1 = (bits >> 15) & 0x1f;
+
+  if (opcode == 0x6f) {
+    return rd ? CALL_CALL : CALL_NONE;
+  }
+  if (opcode == 0x67) {
+    if (rd) {
+      return CALL_CALL;
+    }
+    return rs1 == 1 ? CALL_RETURN : CALL_NONE;
+  }
+  return CALL_NONE;
+}
+
+/* Charges one instruction to the current context and follows calls */
+static inline void callstack_retire(CallStack *stack, Address pc, Word bits,
+                                    Address next_pc) {
+  stack->current->self++;
+  switch (callstack_kind(bits)) {
+  case CALL_CALL:
+    callstack_call(stack, pc, next_pc);
+    break;
+  case CALL_RETURN:
+    callstack_return(stack);
+    break;
+  case CALL_NONE:
+    break;
+  }
+}
+
+#endif
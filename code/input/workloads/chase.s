@@ -0,0 +1,65 @@
+# Pointer chasing through a random single-cycle permutation of 32768
+# word-sized pointers (128 KiB), built with Sattolo's algorithm, then
+# followed for 250000 steps. Prints the final pointer and the sum of the
+# pointers visited.
+
+        .equ N, 32768
+        .equ ARRAY, 0x20000
+        .equ STEPS, 250000
+
+        li      sp, 0xf0000
+        # a[k] = &a[k]
+        li      t0, ARRAY
+        li      t2, N
+identity:
+        sw      t0, 0(t0)
+        addi    t0, t0, 4
+        addi    t2, t2, -1
+        bnez    t2, identity
+
+        # for i = N-1 down to 1: swap a[i] with a[rand % i]
+        li      s0, 42                  # generator state
+        li      s1, N-1                 # i
+        li      t3, 1103515245
+        li      t4, 12345
+        li      s2, ARRAY
+shuffle:
+        mul     s0, s0, t3
+        add     s0, s0, t4
+        srli    t0, s0, 8
+        remu    t0, t0, s1              # j
+        slli    t1, s1, 2
+        add     t1, t1, s2
+        slli    t0, t0, 2
+        add     t0, t0, s2
+        lw      t5, 0(t1)
+        lw      t6, 0(t0)
+        sw      t6, 0(t1)
+        sw      t5, 0(t0)
+        addi    s1, s1, -1
+        bnez    s1, shuffle
+
+        # follow the cycle
+        li      t0, ARRAY
+        li      s3, 0                   # sum
+        li      t2, STEPS
+chase:
+        lw      t0, 0(t0)
+        add     s3, s3, t0
+        addi    t2, t2, -1
+        bnez    t2, chase
+
+        li      a0, 1
+        mv      a1, t0
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        mv      a1, s3
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 10
+        ecall
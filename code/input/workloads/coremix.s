@@ -0,0 +1,316 @@
+# A CoreMark-style mix of list processing, a small matrix multiply and a
+# table-driven state machine, 100 iterations, each folding its results
+# into a running CRC-16 (reflected, polynomial 0xa001). Prints the CRC and
+# the number of fields that ended in each state machine state.
+
+        .equ ITERATIONS, 100
+        .equ NODES, 128
+        .equ LIST, 0x30000              # NODES x {next, value}
+        .equ N, 12
+        .equ MAT_A, 0x40000             # N x N halfwords
+        .equ MAT_B, 0x40400             # N x N halfwords
+        .equ INPUT, 0x41000             # INPUT_SIZE characters
+        .equ INPUT_SIZE, 512
+        .equ CLASSES, 0x41400           # character class of each byte
+        .equ NEXT_STATE, 0x41500        # next state, 8 classes per state
+        .equ COUNTS, 0x41600            # fields ended in each state
+        .equ ALPHABET, 0x41700          # 16 input characters
+
+        # states
+        .equ START, 0
+        .equ INT, 1
+        .equ FLOAT, 2
+        .equ EXP, 3
+        .equ INVALID, 4
+        # character classes
+        .equ DIGIT, 0
+        .equ DOT, 1
+        .equ E, 2
+        .equ MINUS, 3
+        .equ COMMA, 4
+        .equ OTHER, 5
+
+        li      sp, 0xf0000
+        li      s0, 7                   # generator state
+        li      s1, 0                   # crc
+        li      s9, 1103515245
+        li      s10, 12345
+
+        # the list, linked in address order
+        li      t0, LIST
+        li      t2, NODES
+list_init:
+        addi    t1, t0, 8
+        sw      t1, 0(t0)
+        mul     s0, s0, s9
+        add     s0, s0, s10
+        srli    t3, s0, 16
+        sw      t3, 4(t0)
+        mv      t0, t1
+        addi    t2, t2, -1
+        bnez    t2, list_init
+        sw      zero, -8(t0)
+        li      s3, LIST                # head
+
+        # the matrices
+        li      t0, MAT_A
+        li      t1, MAT_B
+        li      t2, N*N
+matrix_init:
+        mul     s0, s0, s9
+        add     s0, s0, s10
+        srai    t3, s0, 24
+        sh      t3, 0(t0)
+        mul     s0, s0, s9
+        add     s0, s0, s10
+        srai    t3, s0, 24
+        sh      t3, 0(t1)
+        addi    t0, t0, 2
+        addi    t1, t1, 2
+        addi    t2, t2, -1
+        bnez    t2, matrix_init
+
+        # character classes: OTHER except for the ones below
+        li      t0, CLASSES
+        li      t2, 256
+        li      t3, OTHER
+class_init:
+        sb      t3, 0(t0)
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, class_init
+        li      t0, CLASSES+'0'
+        li      t2, 10
+digit_init:
+        sb      zero, 0(t0)
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, digit_init
+        li      t0, CLASSES
+        li      t3, DOT
+        sb      t3, '.'(t0)
+        li      t3, E
+        sb      t3, 'e'(t0)
+        li      t3, MINUS
+        sb      t3, '-'(t0)
+        li      t3, COMMA
+        sb      t3, ','(t0)
+
+        # transitions: INVALID unless listed below
+        li      t0, NEXT_STATE
+        li      t2, 40
+        li      t3, INVALID
+state_init:
+        sb      t3, 0(t0)
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, state_init
+        li      t0, NEXT_STATE
+        li      t1, INT
+        li      t2, FLOAT
+        li      t3, EXP
+        sb      t1, START*8+DIGIT(t0)
+        sb      t1, START*8+MINUS(t0)
+        sb      t2, START*8+DOT(t0)
+        sb      t1, INT*8+DIGIT(t0)
+        sb      t2, INT*8+DOT(t0)
+        sb      t3, INT*8+E(t0)
+        sb      t2, FLOAT*8+DIGIT(t0)
+        sb      t3, FLOAT*8+E(t0)
+        sb      t3, EXP*8+DIGIT(t0)
+        sb      t3, EXP*8+MINUS(t0)
+
+        # the input, drawn from a 16 character alphabet
+        li      t0, ALPHABET
+        li      t1, 0x33323130          # "0123"
+        sw      t1, 0(t0)
+        li      t1, 0x37363534          # "4567"
+        sw      t1, 4(t0)
+        li      t1, 0x2d652e38          # "8.e-"
+        sw      t1, 8(t0)
+        li      t1, 0x20392c2c          # ",,9 "
+        sw      t1, 12(t0)
+        li      t0, INPUT
+        li      t2, INPUT_SIZE
+input_init:
+        mul     s0, s0, s9
+        add     s0, s0, s10
+        srli    t3, s0, 16
+        andi    t3, t3, 15
+        li      t4, ALPHABET
+        add     t3, t3, t4
+        lbu     t3, 0(t3)
+        sb      t3, 0(t0)
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, input_init
+
+        li      s2, 0                   # iteration
+iteration:
+        # sum the list values and count the small ones
+        mv      t0, s3
+        li      s4, 0                   # sum
+        li      s5, 0                   # values below 0x8000
+        li      t3, 0x8000
+list_walk:
+        lw      t1, 4(t0)
+        add     s4, s4, t1
+        sltu    t1, t1, t3
+        add     s5, s5, t1
+        lw      t0, 0(t0)
+        bnez    t0, list_walk
+        mv      a0, s4
+        jal     ra, crc_word
+        mv      a0, s5
+        jal     ra, crc_word
+
+        # reverse the list and change the value at its new head
+        li      t1, 0                   # previous
+        mv      t0, s3
+list_reverse:
+        lw      t2, 0(t0)
+        sw      t1, 0(t0)
+        mv      t1, t0
+        mv      t0, t2
+        bnez    t0, list_reverse
+        mv      s3, t1
+        lw      t2, 4(s3)
+        add     t2, t2, s2
+        sw      t2, 4(s3)
+
+        # sum of A * B
+        li      s4, 0
+        li      s5, 0                   # i
+matrix_i:
+        li      s6, 0                   # j
+matrix_j:
+        li      t0, N*2
+        mul     t1, s5, t0
+        li      t2, MAT_A
+        add     t1, t1, t2              # &A[i][0]
+        slli    t2, s6, 1
+        li      t3, MAT_B
+        add     t2, t2, t3              # &B[0][j]
+        li      t3, N
+        li      t4, 0
+matrix_k:
+        lh      t5, 0(t1)
+        lh      t6, 0(t2)
+        mul     t5, t5, t6
+        add     t4, t4, t5
+        addi    t1, t1, 2
+        add     t2, t2, t0
+        addi    t3, t3, -1
+        bnez    t3, matrix_k
+        add     s4, s4, t4
+        addi    s6, s6, 1
+        li      t5, N
+        blt     s6, t5, matrix_j
+        addi    s5, s5, 1
+        blt     s5, t5, matrix_i
+        mv      a0, s4
+        jal     ra, crc_word
+        # bump one element of A
+        li      t0, N*N
+        remu    t0, s2, t0
+        slli    t0, t0, 1
+        li      t1, MAT_A
+        add     t0, t0, t1
+        lh      t1, 0(t0)
+        addi    t1, t1, 1
+        sh      t1, 0(t0)
+
+        # run the state machine over the input
+        li      t0, INPUT
+        li      t2, INPUT_SIZE
+        li      t3, CLASSES
+        li      t4, NEXT_STATE
+        li      t5, COUNTS
+        li      s5, START
+scan:
+        lbu     t1, 0(t0)
+        add     t1, t1, t3
+        lbu     t1, 0(t1)               # class
+        li      t6, COMMA
+        bne     t1, t6, scan_next
+        slli    t6, s5, 2
+        add     t6, t6, t5
+        lw      a1, 0(t6)
+        addi    a1, a1, 1
+        sw      a1, 0(t6)
+        li      s5, START
+        j       scan_step
+scan_next:
+        slli    t6, s5, 3
+        add     t6, t6, t1
+        add     t6, t6, t4
+        lbu     s5, 0(t6)
+scan_step:
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, scan
+        li      s5, COUNTS
+        li      s6, 5
+count_crc:
+        lw      a0, 0(s5)
+        jal     ra, crc_word
+        addi    s5, s5, 4
+        addi    s6, s6, -1
+        bnez    s6, count_crc
+        # change one input character
+        li      t0, 37
+        mul     t0, t0, s2
+        andi    t0, t0, INPUT_SIZE-1
+        li      t1, INPUT
+        add     t0, t0, t1
+        andi    t1, s2, 15
+        li      t2, ALPHABET
+        add     t1, t1, t2
+        lbu     t1, 0(t1)
+        sb      t1, 0(t0)
+
+        addi    s2, s2, 1
+        li      t0, ITERATIONS
+        bltu    s2, t0, iteration
+
+        li      a0, 1
+        mv      a1, s1
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      s5, COUNTS
+        li      s6, 5
+print_counts:
+        li      a0, 1
+        lw      a1, 0(s5)
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        addi    s5, s5, 4
+        addi    s6, s6, -1
+        bnez    s6, print_counts
+        li      a0, 10
+        ecall
+
+# Folds the four bytes of a0, low byte first, into the crc in s1
+crc_word:
+        li      t0, 4
+        li      t2, 0xa001
+crc_byte:
+        andi    t1, a0, 0xff
+        xor     s1, s1, t1
+        li      t1, 8
+crc_bit:
+        andi    t3, s1, 1
+        srli    s1, s1, 1
+        beqz    t3, crc_next
+        xor     s1, s1, t2
+crc_next:
+        addi    t1, t1, -1
+        bnez    t1, crc_bit
+        srli    a0, a0, 8
+        addi    t0, t0, -1
+        bnez    t0, crc_byte
+        ret
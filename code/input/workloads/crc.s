@@ -0,0 +1,71 @@
+# Checksums over a 16 KiB buffer of generated bytes: a bitwise CRC-32
+# (reflected, polynomial 0xedb88320) and a 32-bit FNV-1a hash.
+# Prints both as signed integers.
+
+        .equ SIZE, 16384
+        .equ BUFFER, 0x10000
+
+        li      sp, 0xf0000
+        li      s0, 1                   # generator state
+        li      t0, BUFFER
+        li      t2, SIZE
+        li      t3, 1103515245
+        li      t4, 12345
+fill:
+        mul     s0, s0, t3
+        add     s0, s0, t4
+        srli    t5, s0, 16
+        sb      t5, 0(t0)
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, fill
+
+        # CRC-32, one bit at a time
+        li      s1, -1                  # crc
+        li      s2, 0xedb88320
+        li      t0, BUFFER
+        li      t2, SIZE
+crc_byte:
+        lbu     t1, 0(t0)
+        xor     s1, s1, t1
+        li      t3, 8
+crc_bit:
+        andi    t4, s1, 1
+        srli    s1, s1, 1
+        beqz    t4, crc_next
+        xor     s1, s1, s2
+crc_next:
+        addi    t3, t3, -1
+        bnez    t3, crc_bit
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, crc_byte
+        not     s1, s1
+
+        # FNV-1a
+        li      s3, 2166136261          # hash
+        li      s4, 16777619            # prime
+        li      t0, BUFFER
+        li      t2, SIZE
+fnv:
+        lbu     t1, 0(t0)
+        xor     s3, s3, t1
+        mul     s3, s3, s4
+        addi    t0, t0, 1
+        addi    t2, t2, -1
+        bnez    t2, fnv
+
+        li      a0, 1
+        mv      a1, s1
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        mv      a1, s3
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 10
+        ecall
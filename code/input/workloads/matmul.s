@@ -0,0 +1,104 @@
+# Integer matrix multiply: C = A * B for 40x40 matrices of small signed
+# values from a linear congruential generator, repeated 4 times with
+# different inputs. Prints the sum of C and a rotate-xor hash of C.
+
+        .equ N, 40
+        .equ MAT_A, 0x10000
+        .equ MAT_B, 0x12000
+        .equ MAT_C, 0x14000
+        .equ ROUNDS, 4
+
+        li      sp, 0xf0000
+        li      s0, 12345               # generator state
+        li      s6, ROUNDS
+        li      s4, 0                   # sum of C over all rounds
+        li      s5, 0                   # hash of C over all rounds
+round:
+        # fill A and B, 2*N*N words
+        li      t0, MAT_A
+        li      t1, MAT_B
+        li      t2, N*N
+        li      t3, 1103515245
+fill:
+        mul     s0, s0, t3
+        addi    s0, s0, 0x39            # 12345 = 0x3039
+        li      t4, 0x3000
+        add     s0, s0, t4
+        srli    t5, s0, 16
+        andi    t5, t5, 0xff
+        addi    t5, t5, -128
+        sw      t5, 0(t0)
+        mul     s0, s0, t3
+        addi    s0, s0, 0x39
+        add     s0, s0, t4
+        srli    t5, s0, 16
+        andi    t5, t5, 0xff
+        addi    t5, t5, -128
+        sw      t5, 0(t1)
+        addi    t0, t0, 4
+        addi    t1, t1, 4
+        addi    t2, t2, -1
+        bnez    t2, fill
+
+        # C[i][j] = sum over k of A[i][k] * B[k][j]
+        li      s1, 0                   # i
+        li      a2, MAT_C
+loop_i:
+        li      s2, 0                   # j
+loop_j:
+        li      t0, N*4
+        mul     t1, s1, t0
+        li      t2, MAT_A
+        add     t1, t1, t2              # &A[i][0]
+        slli    t2, s2, 2
+        li      t3, MAT_B
+        add     t2, t2, t3              # &B[0][j]
+        li      t3, N                   # k
+        li      t4, 0                   # acc
+loop_k:
+        lw      t5, 0(t1)
+        lw      t6, 0(t2)
+        mul     t5, t5, t6
+        add     t4, t4, t5
+        addi    t1, t1, 4
+        add     t2, t2, t0
+        addi    t3, t3, -1
+        bnez    t3, loop_k
+        sw      t4, 0(a2)
+        addi    a2, a2, 4
+        addi    s2, s2, 1
+        li      t5, N
+        blt     s2, t5, loop_j
+        addi    s1, s1, 1
+        blt     s1, t5, loop_i
+
+        # fold C into the sum and hash
+        li      t0, MAT_C
+        li      t2, N*N
+fold:
+        lw      t1, 0(t0)
+        add     s4, s4, t1
+        slli    t3, s5, 5
+        srli    t4, s5, 27
+        or      s5, t3, t4
+        xor     s5, s5, t1
+        addi    t0, t0, 4
+        addi    t2, t2, -1
+        bnez    t2, fold
+        addi    s6, s6, -1
+        bnez    s6, round
+
+        li      a0, 1
+        mv      a1, s4
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        mv      a1, s5
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 10
+        ecall
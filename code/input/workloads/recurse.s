@@ -0,0 +1,73 @@
+# Call-heavy recursion: the naive Fibonacci function fib(24) and the
+# Ackermann function A(2, 150), both using the standard calling convention
+# with stack frames. Prints both results.
+
+        li      sp, 0xf0000
+        li      a0, 24
+        jal     ra, fib
+        mv      a1, a0
+        li      a0, 1
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 2
+        li      a1, 150
+        jal     ra, ack
+        mv      a1, a0
+        li      a0, 1
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 10
+        ecall
+
+# fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2)
+fib:
+        li      t0, 2
+        blt     a0, t0, fib_done
+        addi    sp, sp, -12
+        sw      ra, 8(sp)
+        sw      s0, 4(sp)
+        sw      s1, 0(sp)
+        mv      s0, a0
+        addi    a0, a0, -1
+        jal     ra, fib
+        mv      s1, a0
+        addi    a0, s0, -2
+        jal     ra, fib
+        add     a0, a0, s1
+        lw      s1, 0(sp)
+        lw      s0, 4(sp)
+        lw      ra, 8(sp)
+        addi    sp, sp, 12
+fib_done:
+        ret
+
+# A(0, n) = n + 1, A(m, 0) = A(m - 1, 1), A(m, n) = A(m - 1, A(m, n - 1))
+ack:
+        bnez    a0, ack_m
+        addi    a0, a1, 1
+        ret
+ack_m:
+        addi    sp, sp, -8
+        sw      ra, 4(sp)
+        sw      s0, 0(sp)
+        mv      s0, a0
+        bnez    a1, ack_n
+        addi    a0, a0, -1
+        li      a1, 1
+        jal     ra, ack
+        j       ack_done
+ack_n:
+        addi    a1, a1, -1
+        jal     ra, ack
+        mv      a1, a0
+        addi    a0, s0, -1
+        jal     ra, ack
+ack_done:
+        lw      s0, 0(sp)
+        lw      ra, 4(sp)
+        addi    sp, sp, 8
+        ret
@@ -0,0 +1,88 @@
+# Insertion sort of 1024 signed words from a linear congruential generator.
+# Prints 1 if the result is in order, the smallest and largest values and
+# a rotate-xor hash of the sorted array.
+
+        .equ N, 1024
+        .equ ARRAY, 0x10000
+
+        li      sp, 0xf0000
+        li      s0, 2463534242          # generator state
+        li      t0, ARRAY
+        li      t2, N
+        li      t3, 1103515245
+        li      t4, 12345
+fill:
+        mul     s0, s0, t3
+        add     s0, s0, t4
+        srai    t5, s0, 8
+        sw      t5, 0(t0)
+        addi    t0, t0, 4
+        addi    t2, t2, -1
+        bnez    t2, fill
+
+        # for i in 1..N-1: shift larger elements of a[0..i) up, insert a[i]
+        li      s1, ARRAY+4
+        li      s2, ARRAY+N*4
+        li      s3, ARRAY
+outer:
+        lw      t0, 0(s1)               # key
+        addi    t1, s1, -4
+inner:
+        lw      t2, 0(t1)
+        ble     t2, t0, insert
+        sw      t2, 4(t1)
+        addi    t1, t1, -4
+        bgeu    t1, s3, inner
+insert:
+        sw      t0, 4(t1)
+        addi    s1, s1, 4
+        bltu    s1, s2, outer
+
+        # check the order and hash the result
+        li      s4, 1                   # in order
+        li      s5, 0                   # hash
+        li      t0, ARRAY
+        li      t2, N
+        lw      t3, 0(t0)
+check:
+        lw      t1, 0(t0)
+        bge     t1, t3, ordered
+        li      s4, 0
+ordered:
+        mv      t3, t1
+        slli    t4, s5, 7
+        srli    t5, s5, 25
+        or      s5, t4, t5
+        xor     s5, s5, t1
+        addi    t0, t0, 4
+        addi    t2, t2, -1
+        bnez    t2, check
+
+        li      a0, 1
+        mv      a1, s4
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        li      t0, ARRAY
+        lw      a1, 0(t0)
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        li      t0, ARRAY+(N-1)*4
+        lw      a1, 0(t0)
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 1
+        mv      a1, s5
+        ecall
+        li      a0, 11
+        li      a1, 10
+        ecall
+        li      a0, 10
+        ecall
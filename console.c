@@ -0,0 +1,48 @@
+#include "console.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static char console_buffer[CONSOLE_BUFFER_SIZE];
+
+/* Switches stdout to the console buffer. Must run before anything is
+ * written to stdout; a terminal keeps its line buffering so that output
+ * and prompts show up as they are printed. */
+void console_init(void) {
+  if (!isatty(STDOUT_FILENO)) {
+    setvbuf(stdout, console_buffer, _IOFBF, sizeof(console_buffer));
+  }
+}
+
+/* Prints value in decimal, as printf("%d") would */
+void console_write_int(sWord value) {
+  char digits[12];
+  char *p = digits + sizeof(digits);
+  Word magnitude = value < 0 ? -(Word)value : (Word)value;
+
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0) {
+    *--p = '-';
+  }
+  fwrite(p, 1, digits + sizeof(digits) - p, stdout);
+}
+
+void console_write_char(Byte c) { putchar(c); }
+
+/* Prints the NUL-terminated string at address, stopping at the end of
+ * memory if there is no terminator */
+void console_write_string(const Byte *memory, Address address) {
+  const Byte *end;
+
+  if (address >= MEMORY_SPACE) {
+    return;
+  }
+  end = memchr(memory + address, 0, MEMORY_SPACE - address);
+  fwrite(memory + address, 1,
+         (end ? end : memory + MEMORY_SPACE) - (memory + address), stdout);
+}
+
+void console_flush(void) { fflush(stdout); }
@@ -0,0 +1,21 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "types.h"
+
+/* Guest console output for the print ecalls. Everything goes to stdout
+   through one large buffer, so that text traces written to stdout stay in
+   order with it; the buffer is written out when full, when the guest asks
+   with the flush ecall, and at exit. */
+#define CONSOLE_BUFFER_SIZE (1 << 20)
+
+/* a0 value of the ecall that flushes the console */
+#define ECALL_FLUSH 18
+
+void console_init(void);
+void console_write_int(sWord value);
+void console_write_char(Byte c);
+void console_write_string(const Byte *memory, Address address);
+void console_flush(void);
+
+#endif
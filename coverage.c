@@ -0,0 +1,108 @@
+#include "coverage.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+Byte *coverage_map;
+Word coverage_prev;
+
+/* Attaches the segment afl-fuzz created. Returns 0 on success. */
+static int attach_shm(const char *id) {
+  char *end;
+  long shm_id = strtol(id, &end, 10);
+  void *map;
+
+  if (end == id || *end != '\0') {
+    fprintf(stderr, "Bad %s %s\n", COVERAGE_SHM_ENV, id);
+    return -1;
+  }
+  map = shmat(shm_id, NULL, 0);
+  if (map == (void *)-1) {
+    perror("shmat");
+    return -1;
+  }
+  coverage_map = map;
+  return 0;
+}
+
+/* Maps filename, cleared, as the bitmap. Returns 0 on success. */
+static int map_file(const char *filename) {
+  void *map;
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0 || ftruncate(fd, COVERAGE_MAP_SIZE) != 0) {
+    fprintf(stderr, "Cannot create coverage map %s\n", filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  map = mmap(NULL, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  coverage_map = map;
+  return 0;
+}
+
+/* Serves afl-fuzz's fork server if it is listening. Returns in a child for
+ * each run, or right away if there is no fork server; the server itself
+ * exits when afl-fuzz goes away. */
+static void fork_server(void) {
+  Word message = 0;
+  int status;
+  pid_t pid;
+
+  if (write(COVERAGE_FORKSRV_FD + 1, &message, sizeof(message)) !=
+      sizeof(message)) {
+    return;
+  }
+  while (read(COVERAGE_FORKSRV_FD, &message, sizeof(message)) ==
+         sizeof(message)) {
+    pid = fork();
+    if (pid < 0) {
+      break;
+    }
+    if (pid == 0) {
+      close(COVERAGE_FORKSRV_FD);
+      close(COVERAGE_FORKSRV_FD + 1);
+      return;
+    }
+    if (write(COVERAGE_FORKSRV_FD + 1, &pid, sizeof(pid)) != sizeof(pid) ||
+        waitpid(pid, &status, 0) != pid ||
+        write(COVERAGE_FORKSRV_FD + 1, &status, sizeof(status)) !=
+            sizeof(status)) {
+      break;
+    }
+  }
+  /* leave the analyses' atexit handlers to the children */
+  _exit(0);
+}
+
+/* Starts recording edges into the afl-fuzz segment or, without one, into
+ * filename. Returns 0 on success. */
+int coverage_open(const char *filename) {
+  const char *id = getenv(COVERAGE_SHM_ENV);
+
+  if (id != NULL) {
+    if (attach_shm(id) != 0) {
+      return -1;
+    }
+    fork_server();
+  } else if (filename == NULL) {
+    fprintf(stderr, "--coverage needs a FILE when %s is not set\n",
+            COVERAGE_SHM_ENV);
+    return -1;
+  } else if (map_file(filename) != 0) {
+    return -1;
+  }
+  coverage_prev = 0;
+  return 0;
+}
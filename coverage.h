@@ -0,0 +1,33 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "types.h"
+
+/* AFL-style edge coverage (--coverage[=FILE]). Every branch outcome and
+   jump bumps one byte of a 64 KiB bitmap, indexed by a hash of the
+   previous and the new target, as afl-fuzz expects. When afl-fuzz runs the
+   simulator it passes the System V shared memory segment to use in
+   __AFL_SHM_ID, and the simulator also serves afl-fuzz's fork server
+   protocol, forking before the program is loaded. Otherwise FILE is mapped
+   shared, so other processes can watch the bitmap as the program runs.
+
+   When it is off, the branch and jump handlers test coverage_map and do
+   nothing else. */
+#define COVERAGE_MAP_SIZE 65536 /* afl-fuzz's MAP_SIZE */
+#define COVERAGE_SHM_ENV "__AFL_SHM_ID"
+#define COVERAGE_FORKSRV_FD 198 /* and 199, see afl-fuzz */
+
+extern Byte *coverage_map;
+extern Word coverage_prev;
+
+int coverage_open(const char *filename);
+
+/* Records control arriving at target */
+static inline void coverage_edge(Address target) {
+  Word location = ((target >> 2) * 0x9e3779b1U) >> 16;
+
+  coverage_map[location ^ coverage_prev]++;
+  coverage_prev = location >> 1;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "csr.h"
+#include "riscv.h"
+#include <time.h>
+
+static Word mscratch;
+
+/* Returns the assembler name of csr, or NULL if it is not implemented */
+const char *csr_name(unsigned int csr) {
+  switch (csr) {
+  case CSR_MSCRATCH:
+    return "mscratch";
+  case CSR_CYCLE:
+    return "cycle";
+  case CSR_TIME:
+    return "time";
+  case CSR_INSTRET:
+    return "instret";
+  case CSR_CYCLEH:
+    return "cycleh";
+  case CSR_TIMEH:
+    return "timeh";
+  case CSR_INSTRETH:
+    return "instreth";
+  default:
+    return NULL;
+  }
+}
+
+static Double host_time(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (Double)now.tv_sec * CSR_TIME_FREQUENCY +
+         now.tv_nsec / (1000000000 / CSR_TIME_FREQUENCY);
+}
+
+/* Reads csr into value. Returns -1 if csr is not implemented. */
+int csr_read(unsigned int csr, Word *value) {
+  switch (csr) {
+  case CSR_MSCRATCH:
+    *value = mscratch;
+    break;
+  case CSR_CYCLE:
+  case CSR_INSTRET:
+    *value = retired;
+    break;
+  case CSR_CYCLEH:
+  case CSR_INSTRETH:
+    *value = retired >> 32;
+    break;
+  case CSR_TIME:
+    *value = host_time();
+    break;
+  case CSR_TIMEH:
+    *value = host_time() >> 32;
+    break;
+  default:
+    return -1;
+  }
+  return 0;
+}
+
+/* Writes value to csr. Returns -1 if csr is read-only or not implemented. */
+int csr_write(unsigned int csr, Word value) {
+  if (csr != CSR_MSCRATCH) {
+    return -1;
+  }
+  mscratch = value;
+  return 0;
+}
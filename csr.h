@@ -0,0 +1,27 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include "types.h"
+
+/* Control and status registers for the Zicsr instructions. The user-level
+   counters are read-only: cycle and instret both count the instructions
+   retired so far (the simulator retires one per cycle), and time counts
+   microseconds of host monotonic time. Nothing is updated per instruction;
+   every counter is worked out when it is read. mscratch is the one
+   writable register, for guests that want to exercise csrrw and friends. */
+#define CSR_MSCRATCH 0x340
+#define CSR_CYCLE 0xc00
+#define CSR_TIME 0xc01
+#define CSR_INSTRET 0xc02
+#define CSR_CYCLEH 0xc80
+#define CSR_TIMEH 0xc81
+#define CSR_INSTRETH 0xc82
+
+/* Ticks of the time counter per second */
+#define CSR_TIME_FREQUENCY 1000000
+
+const char *csr_name(unsigned int csr);
+int csr_read(unsigned int csr, Word *value);
+int csr_write(unsigned int csr, Word value);
+
+#endif
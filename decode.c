@@ -0,0 +1,177 @@
+#include "decode.h"
+#include "riscv.h"
+#include "utils.h"
+
+/* Decodes the instruction once into a flat form so that execute_decoded() can
+ * dispatch on a single byte with the immediate already sign-extended. Only the
+ * canonical encodings that part2.c handles are specialised; everything else
+ * falls back to the interpreter so both engines always agree. */
+DecodedInstruction predecode_instruction(Word instruction_bits) {
+  DecodedInstruction decoded = {instruction_bits, OP_INTERP, 0, 0, 0, 0};
+  Instruction instruction;
+
+  instruction.bits = instruction_bits;
+
+  switch (instruction.opcode) {
+  case 0x33:
+    decoded.rd = instruction.rtype.rd;
+    decoded.rs1 = instruction.rtype.rs1;
+    decoded.rs2 = instruction.rtype.rs2;
+    switch (instruction.rtype.funct3 | (instruction.rtype.funct7 << 3)) {
+    case 0x0:
+      decoded.op = OP_ADD;
+      break;
+    case 0x0 | (0x1 << 3):
+      decoded.op = OP_MUL;
+      break;
+    case 0x0 | (0x20 << 3):
+      decoded.op = OP_SUB;
+      break;
+    case 0x2:
+      decoded.op = OP_SLT;
+      break;
+    case 0x4:
+      decoded.op = OP_XOR;
+      break;
+    case 0x6:
+      decoded.op = OP_OR;
+      break;
+    case 0x7:
+      decoded.op = OP_AND;
+      break;
+    }
+    break;
+  case 0x13:
+    decoded.rd = instruction.itype.rd;
+    decoded.rs1 = instruction.itype.rs1;
+    decoded.imm = sign_extend_number(instruction.itype.imm, 12);
+    switch (instruction.itype.funct3) {
+    case 0x0:
+      decoded.op = OP_ADDI;
+      break;
+    case 0x1:
+      decoded.op = OP_SLLI;
+      decoded.imm &= 0x1f;
+      break;
+    case 0x2:
+      decoded.op = OP_SLTI;
+      break;
+    case 0x4:
+      decoded.op = OP_XORI;
+      break;
+    case 0x6:
+      decoded.op = OP_ORI;
+      break;
+    }
+    break;
+  case 0x03:
+    decoded.rd = instruction.itype.rd;
+    decoded.rs1 = instruction.itype.rs1;
+    decoded.imm = sign_extend_number(instruction.itype.imm, 12);
+    if (instruction.itype.funct3 == 0x2) {
+      decoded.op = OP_LW;
+    }
+    break;
+  case 0x23:
+    decoded.rs1 = instruction.stype.rs1;
+    decoded.rs2 = instruction.stype.rs2;
+    decoded.imm = get_store_offset(instruction);
+    switch (instruction.stype.funct3) {
+    case 0x0:
+      decoded.op = OP_SB;
+      break;
+    case 0x1:
+      decoded.op = OP_SH;
+      break;
+    case 0x2:
+      decoded.op = OP_SW;
+      break;
+    }
+    break;
+  case 0x37:
+    decoded.op = OP_LUI;
+    decoded.rd = instruction.utype.rd;
+    decoded.imm = (sWord)(instruction.utype.imm << 12);
+    break;
+  }
+  return decoded;
+}
+
+/* Predecodes count consecutive words of memory starting at base */
+void predecode_range(DecodedInstruction *out, const Byte *memory,
+                     Address base, Word count) {
+  Word i;
+
+  for (i = 0; i < count; i++) {
+    out[i] = predecode_instruction(load((Byte *)memory, base + 4 * i,
+                                        LENGTH_WORD));
+  }
+}
+
+void execute_decoded(const DecodedInstruction *decoded, Processor *processor,
+                     Byte *memory) {
+  Register *R = processor->R;
+
+  switch (decoded->op) {
+  case OP_ADD:
+    R[decoded->rd] = R[decoded->rs1] + R[decoded->rs2];
+    break;
+  case OP_SUB:
+    R[decoded->rd] = R[decoded->rs1] - R[decoded->rs2];
+    break;
+  case OP_MUL:
+    R[decoded->rd] = R[decoded->rs1] * R[decoded->rs2];
+    break;
+  case OP_SLT:
+    R[decoded->rd] = (sWord)R[decoded->rs1] < (sWord)R[decoded->rs2];
+    break;
+  case OP_XOR:
+    R[decoded->rd] = R[decoded->rs1] ^ R[decoded->rs2];
+    break;
+  case OP_OR:
+    R[decoded->rd] = R[decoded->rs1] | R[decoded->rs2];
+    break;
+  case OP_AND:
+    R[decoded->rd] = R[decoded->rs1] & R[decoded->rs2];
+    break;
+  case OP_ADDI:
+    R[decoded->rd] = R[decoded->rs1] + decoded->imm;
+    break;
+  case OP_SLLI:
+    R[decoded->rd] = R[decoded->rs1] << decoded->imm;
+    break;
+  case OP_SLTI:
+    R[decoded->rd] = (sWord)R[decoded->rs1] < decoded->imm;
+    break;
+  case OP_XORI:
+    R[decoded->rd] = R[decoded->rs1] ^ decoded->imm;
+    break;
+  case OP_ORI:
+    R[decoded->rd] = R[decoded->rs1] | decoded->imm;
+    break;
+  case OP_LW:
+    R[decoded->rd] =
+        load(memory, R[decoded->rs1] + decoded->imm, LENGTH_WORD);
+    break;
+  case OP_SB:
+    store(memory, R[decoded->rs1] + decoded->imm, LENGTH_BYTE,
+          R[decoded->rs2]);
+    break;
+  case OP_SH:
+    store(memory, R[decoded->rs1] + decoded->imm, LENGTH_HALF_WORD,
+          R[decoded->rs2]);
+    break;
+  case OP_SW:
+    store(memory, R[decoded->rs1] + decoded->imm, LENGTH_WORD,
+          R[decoded->rs2]);
+    break;
+  case OP_LUI:
+    R[decoded->rd] = decoded->imm;
+    break;
+  default:
+    /* not specialised, execute_instruction() advances the PC itself */
+    execute_instruction(decoded->bits, processor, memory);
+    return;
+  }
+  processor->PC += 4;
+}
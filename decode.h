@@ -0,0 +1,69 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Operations the predecoded engine executes directly. Anything that is not
+   listed here (or is not in its canonical encoding) is decoded as OP_INTERP
+   and handed back to execute_instruction() in part2.c. */
+typedef enum {
+  OP_INTERP = 0,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_SLT,
+  OP_XOR,
+  OP_OR,
+  OP_AND,
+  OP_ADDI,
+  OP_SLLI,
+  OP_SLTI,
+  OP_XORI,
+  OP_ORI,
+  OP_LW,
+  OP_SB,
+  OP_SH,
+  OP_SW,
+  OP_LUI,
+  OP_COUNT
+} Opcode;
+
+/* One predecoded instruction. The layout is part of the .rvimg format (see
+   image.h), so keep it fixed-size and free of pointers. */
+typedef struct {
+  Word bits; /* original encoding, used to detect stale entries */
+  Byte op;   /* an Opcode */
+  Byte rd;
+  Byte rs1;
+  Byte rs2;
+  sWord imm; /* sign-extended immediate or offset */
+} DecodedInstruction;
+
+/* A table of predecoded instructions covering [base, base + 4 * count) */
+typedef struct {
+  const DecodedInstruction *entries;
+  Address base;
+  Word count;
+} DecodeCache;
+
+DecodedInstruction predecode_instruction(Word instruction_bits);
+void predecode_range(DecodedInstruction *out, const Byte *memory,
+                     Address base, Word count);
+void execute_decoded(const DecodedInstruction *decoded, Processor *processor,
+                     Byte *memory);
+
+/* Returns the cached entry for pc, or NULL if pc is outside the cache or the
+   word in memory no longer matches what was decoded. */
+static inline const DecodedInstruction *
+decode_cache_lookup(const DecodeCache *cache, Address pc, Word bits) {
+  Word index = (pc - cache->base) >> 2;
+
+  if (((pc - cache->base) & 3) || index >= cache->count ||
+      cache->entries[index].bits != bits) {
+    return NULL;
+  }
+  return &cache->entries[index];
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "riscv.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* The -d engine. The image is split into chunks of DISASM_CHUNK instructions
+ * that worker threads format into their own buffers; the calling thread
+ * writes the finished chunks to stdout in order with one write() each. */
+
+#define DISASM_CHUNK 16384
+#define DISASM_MAX_THREADS 16
+#define DISASM_PREFIX 10 /* "%08x: " */
+
+typedef struct {
+  char *buf;
+  size_t len;
+  int done;
+} Chunk;
+
+typedef struct {
+  const Byte *memory;
+  Address base;
+  Word count;
+  Chunk *chunks;
+  Word num_chunks;
+  Word next_chunk;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} Disassembly;
+
+static void format_chunk(Disassembly *d, Word chunk) {
+  static const char hex[] = "0123456789abcdef";
+  Word first = chunk * DISASM_CHUNK;
+  Word last = first + DISASM_CHUNK < d->count ? first + DISASM_CHUNK : d->count;
+  char *out = d->chunks[chunk].buf;
+  Word i;
+  int j;
+
+  for (i = first; i < last; i++) {
+    Address address = d->base + 4 * i;
+
+    for (j = 7; j >= 0; j--) {
+      *out++ = hex[(address >> (4 * j)) & 0xf];
+    }
+    *out++ = ':';
+    *out++ = ' ';
+    out += format_instruction(
+        out, DISASM_LINE_MAX,
+        load((Byte *)d->memory, address, LENGTH_WORD));
+  }
+  d->chunks[chunk].len = out - d->chunks[chunk].buf;
+}
+
+static void *disasm_worker(void *arg) {
+  Disassembly *d = arg;
+  Word chunk;
+
+  while ((chunk = __atomic_fetch_add(&d->next_chunk, 1, __ATOMIC_RELAXED)) <
+         d->num_chunks) {
+    format_chunk(d, chunk);
+
+    pthread_mutex_lock(&d->lock);
+    d->chunks[chunk].done = 1;
+    pthread_cond_broadcast(&d->ready);
+    pthread_mutex_unlock(&d->lock);
+  }
+  return NULL;
+}
+
+/* Disassembles count instructions starting at base to stdout, in the same
+ * format as decode_instruction(). Like the loader, it stops at the first word
+ * parse_instruction() cannot unpack and returns -1 in that case. */
+int disassemble(const Byte *memory, Address base, Word count) {
+  Disassembly d;
+  pthread_t threads[DISASM_MAX_THREADS];
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  Word valid, chunk;
+  int i, started = 0, status = 0;
+
+  /* find where parse_instruction() would have given up */
+  for (valid = 0; valid < count; valid++) {
+    if (!is_known_opcode(load((Byte *)memory, base + 4 * valid, LENGTH_WORD) &
+                         0x7f)) {
+      break;
+    }
+  }
+
+  d.memory = memory;
+  d.base = base;
+  d.count = valid;
+  d.num_chunks = (valid + DISASM_CHUNK - 1) / DISASM_CHUNK;
+  d.next_chunk = 0;
+  d.chunks = calloc(d.num_chunks + 1, sizeof(Chunk));
+  if (d.chunks == NULL) {
+    fprintf(stderr, "Out of memory disassembling\n");
+    return -1;
+  }
+  for (chunk = 0; chunk < d.num_chunks; chunk++) {
+    d.chunks[chunk].buf =
+        malloc((size_t)DISASM_CHUNK * (DISASM_PREFIX + DISASM_LINE_MAX));
+    if (d.chunks[chunk].buf == NULL) {
+      fprintf(stderr, "Out of memory disassembling\n");
+      exit(-1);
+    }
+  }
+  pthread_mutex_init(&d.lock, NULL);
+  pthread_cond_init(&d.ready, NULL);
+
+  if (num_threads > DISASM_MAX_THREADS) {
+    num_threads = DISASM_MAX_THREADS;
+  }
+  if (num_threads > (long)d.num_chunks) {
+    num_threads = d.num_chunks;
+  }
+  /* a single chunk is formatted by the calling thread below */
+  for (i = 0; num_threads > 1 && i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, disasm_worker, &d) != 0) {
+      break;
+    }
+    started++;
+  }
+
+  fflush(stdout);
+  for (chunk = 0; chunk < d.num_chunks; chunk++) {
+    if (started == 0) {
+      format_chunk(&d, chunk);
+    } else {
+      pthread_mutex_lock(&d.lock);
+      while (!d.chunks[chunk].done) {
+        pthread_cond_wait(&d.ready, &d.lock);
+      }
+      pthread_mutex_unlock(&d.lock);
+    }
+    if (write_all(STDOUT_FILENO, d.chunks[chunk].buf, d.chunks[chunk].len)) {
+      status = -1;
+    }
+    free(d.chunks[chunk].buf);
+  }
+
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  /* the loader printed the address before giving up on the word */
+  if (valid < count) {
+    printf("%08x: ", base + 4 * valid);
+  }
+  pthread_cond_destroy(&d.ready);
+  pthread_mutex_destroy(&d.lock);
+  free(d.chunks);
+
+  return valid < count ? -1 : status;
+}
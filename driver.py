@@ -93,6 +93,70 @@ tests_json = """{
       "diff ./code/out/UJ/UJ.trace ./code/ref/UJ/UJ.trace": 10
     }
   },
+  "JALR": {
+    "Part1": {
+      "./riscv -d ./code/input/jalr.input > ./code/out/jalr.solution": 0,
+      "diff ./code/out/jalr.solution ./code/ref/jalr.solution": 10
+    },
+    "Part2": {
+      "timeout 60 ./riscv -r -e ./code/input/jalr.input > ./code/out/jalr.trace": 0,
+      "./rvcmp -d -m 0 ./code/ref/jalr.trace ./code/out/jalr.trace": 10,
+      "timeout 60 ./riscv -e --trace-file=./code/out/jalr.delta --trace-format=delta ./code/input/jalr.input": 0,
+      "./rvcmp -d -m 0 ./code/ref/jalr.trace ./code/out/jalr.delta": 10
+    }
+  },
+  "M": {
+    "Part1": {
+      "./riscv -d ./code/input/muldiv.input > ./code/out/muldiv.solution": 0,
+      "diff ./code/out/muldiv.solution ./code/ref/muldiv.solution": 10
+    },
+    "Part2": {
+      "timeout 60 ./riscv -r -e ./code/input/muldiv.input > ./code/out/muldiv.trace": 0,
+      "./rvcmp -d -m 0 ./code/ref/muldiv.trace ./code/out/muldiv.trace": 10
+    }
+  },
+  "CSR": {
+    "Part1": {
+      "./riscv -d ./code/input/csr.input > ./code/out/csr.solution": 0,
+      "diff ./code/out/csr.solution ./code/ref/csr.solution": 10
+    },
+    "Part2": {
+      "timeout 60 ./riscv -r -e ./code/input/csr.input > ./code/out/csr.trace": 0,
+      "./rvcmp -d -m 0 ./code/ref/csr.trace ./code/out/csr.trace": 10
+    }
+  },
+  "Compressed": {
+    "Part1": {
+    },
+    "Part2": {
+      "timeout 60 ./riscv -e --trace-file=./code/out/random.bin.z --trace-format=bin --trace-compress ./code/input/random.input": 0,
+      "./rvcmp -d -m 0 ./code/ref/random.trace ./code/out/random.bin.z": 10,
+      "timeout 60 ./riscv -e --trace-file=./code/out/random.delta.z --trace-format=delta --trace-compress ./code/input/random.input": 0,
+      "./rvcmp -d -m 0 ./code/ref/random.trace ./code/out/random.delta.z": 10,
+      "timeout 60 ./riscv -e --trace-file=./code/out/sort.delta --trace-format=delta --trace-keyframe=4096 ./code/input/workloads/sort.input": 0,
+      "timeout 60 ./riscv -e --trace-file=./code/out/sort.bin.z --trace-format=bin --trace-compress ./code/input/workloads/sort.input": 0,
+      "timeout 60 ./riscv -e --trace-file=./code/out/sort.delta.z --trace-format=delta --trace-compress --trace-keyframe=4096 ./code/input/workloads/sort.input": 0,
+      "./rvcmp -m 0 ./code/out/sort.delta ./code/out/sort.bin.z": 10,
+      "./rvcmp -m 0 ./code/out/sort.delta ./code/out/sort.delta.z": 10,
+      "./rvtrace -s 1000000 -n 8 ./code/out/sort.delta > ./code/out/sort.delta.window": 0,
+      "diff ./code/out/sort.delta.window ./code/ref/workloads/sort.window.trace": 10,
+      "./rvtrace -s 1000000 -n 8 ./code/out/sort.bin.z > ./code/out/sort.bin.z.window": 0,
+      "diff ./code/out/sort.bin.z.window ./code/ref/workloads/sort.window.trace": 10,
+      "./rvtrace -s 1000000 -n 8 ./code/out/sort.delta.z > ./code/out/sort.delta.z.window": 0,
+      "diff ./code/out/sort.delta.z.window ./code/ref/workloads/sort.window.trace": 10
+    }
+  },
+  "Image": {
+    "Part1": {
+      "./riscv --write-image=./code/out/random.rvimg ./code/input/random.input": 0,
+      "./riscv -d ./code/out/random.rvimg > ./code/out/random.image.solution": 0,
+      "diff ./code/out/random.image.solution ./code/ref/random.solution": 10
+    },
+    "Part2": {
+      "timeout 60 ./riscv -r -e ./code/out/random.rvimg > ./code/out/random.image.trace": 0,
+      "./rvcmp -d -m 0 ./code/ref/random.trace ./code/out/random.image.trace": 10
+    }
+  },
   "Custom": {
     "Part1": {
       "./riscv -d ./code/input/custom.input > ./code/out/custom.solution": 0,
@@ -114,11 +178,11 @@ tests_json = """{
     },
     "Part2": {
       "timeout 60 ./riscv -r -e ./code/input/simple.input > ./code/out/simple.trace": 0,
-      "python3 part2_tester.py simple": 30,
+      "./rvcmp -d -m 0 ./code/ref/simple.trace ./code/out/simple.trace": 30,
       "timeout 60 ./riscv -r -e ./code/input/multiply.input > ./code/out/multiply.trace": 0,
-      "python3 part2_tester.py multiply": 30,
+      "./rvcmp -d -m 0 ./code/ref/multiply.trace ./code/out/multiply.trace": 30,
       "timeout 60 ./riscv -r -e ./code/input/random.input > ./code/out/random.trace": 0,
-      "python3 part2_tester.py random": 30
+      "./rvcmp -d -m 0 ./code/ref/random.trace ./code/out/random.trace": 30
     }
   }
 }
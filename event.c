@@ -0,0 +1,97 @@
+#include "event.h"
+#include "utils.h"
+
+/* Bytes accessed by a load or store with the given funct3 */
+static Byte access_size(unsigned int funct3) {
+  switch (funct3 & 0x3) {
+  case 0x0:
+    return LENGTH_BYTE;
+  case 0x1:
+    return LENGTH_HALF_WORD;
+  default:
+    return LENGTH_WORD;
+  }
+}
+
+void event_begin(RetireEvent *event, Address pc, Word bits,
+                 const Processor *processor) {
+  Instruction instruction;
+
+  instruction.bits = bits;
+  event->pc = pc;
+  event->bits = bits;
+  event->rd = event_destination(bits);
+  event->mem_size = 0;
+  event->mem_write = 0;
+
+  switch (instruction.opcode) {
+  case 0x03:
+    event->mem_size = access_size(instruction.itype.funct3);
+    event->mem_addr = processor->R[instruction.itype.rs1] +
+                      sign_extend_number(instruction.itype.imm, 12);
+    break;
+  case 0x23:
+    event->mem_size = access_size(instruction.stype.funct3);
+    event->mem_write = 1;
+    event->mem_addr =
+        processor->R[instruction.stype.rs1] + get_store_offset(instruction);
+    event->mem_value = processor->R[instruction.stype.rs2];
+    if (event->mem_size < LENGTH_WORD) {
+      event->mem_value &= (1U << (8 * event->mem_size)) - 1;
+    }
+    break;
+  }
+}
+
+/* Finds the register an instruction writes, 0 for none */
+int event_destination(Word bits) {
+  Instruction instruction;
+
+  instruction.bits = bits;
+  switch (instruction.opcode) {
+  case 0x33:
+  case 0x13:
+  case 0x03:
+  case 0x37:
+  case 0x17:
+  case 0x6F:
+  case 0x67:
+    return instruction.rtype.rd;
+  case 0x73:
+    /* csr instructions write rd, ecalls have funct3 0 and rd 0 */
+    return instruction.itype.rd;
+  }
+  return 0;
+}
+
+/* Finds the registers an instruction reads, 0 for none */
+void event_sources(Word bits, int *rs1, int *rs2) {
+  Instruction instruction;
+
+  instruction.bits = bits;
+  *rs1 = *rs2 = 0;
+  switch (instruction.opcode) {
+  case 0x33:
+  case 0x23:
+  case 0x63:
+    *rs1 = instruction.rtype.rs1;
+    *rs2 = instruction.rtype.rs2;
+    break;
+  case 0x13:
+  case 0x03:
+  case 0x67:
+    *rs1 = instruction.itype.rs1;
+    break;
+  case 0x73:
+    /* the immediate csr forms use the field as a value */
+    if (!(instruction.itype.funct3 & 0x4)) {
+      *rs1 = instruction.itype.rs1;
+    }
+    break;
+  }
+}
+
+void event_end(RetireEvent *event, const Processor *processor) {
+  event->next_pc = processor->PC;
+  event->rd_value = processor->R[event->rd];
+}
@@ -0,0 +1,27 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "types.h"
+
+/* What one retired instruction did, as seen by traces and analyses.
+   event_begin() fills in everything that depends on the state before the
+   instruction executes, event_end() the rest. */
+typedef struct {
+  Address pc;
+  Word bits;
+  Address next_pc;
+  Byte rd;        /* destination register, 0 if none */
+  Byte mem_size;  /* bytes loaded or stored, 0 if no memory access */
+  Byte mem_write; /* 1 for stores */
+  Address mem_addr;
+  Word mem_value; /* value stored, truncated to mem_size */
+  Word rd_value;  /* value of rd after the instruction */
+} RetireEvent;
+
+void event_begin(RetireEvent *event, Address pc, Word bits,
+                 const Processor *processor);
+void event_end(RetireEvent *event, const Processor *processor);
+int event_destination(Word bits);
+void event_sources(Word bits, int *rs1, int *rs2);
+
+#endif
@@ -0,0 +1,306 @@
+#include "heatmap.h"
+#include "riscv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Characters for no accesses and then for ever higher counts */
+static const char heat_scale[] = " .:-=+*#%@";
+#define HEAT_LEVELS (sizeof(heat_scale) - 1)
+
+/* One window of the working-set curve, in granules */
+typedef struct {
+  Word working_set;
+  Word footprint;
+} Window;
+
+int heatmap_enabled;
+
+static Word granule = HEATMAP_DEFAULT_GRANULE;
+static Word window_length = HEATMAP_DEFAULT_WINDOW;
+static char *heatmap_filename;
+static Word granule_bits;
+static Word granules;  /* in guest memory */
+static Double *reads;  /* loads that touched each granule */
+static Double *writes; /* stores that touched each granule */
+static Word *stamps;   /* last window each granule was touched in, plus 1 */
+static Window *windows;
+static Word window_count, window_size;
+static Double window_end; /* first instruction after the current window */
+static Word working_set;  /* of the current window */
+static Word footprint;    /* granules touched so far */
+static Double loads, stores;
+
+static int is_power_of_two(Word n) { return n && !(n & (n - 1)); }
+
+/* Parses NAME:VALUE, such as granule:64. Returns 0 on success. */
+int heatmap_configure(const char *arg) {
+  const char *colon = strchr(arg, ':');
+  unsigned long value;
+  char *end;
+
+  if (colon == NULL) {
+    return -1;
+  }
+  value = strtoul(colon + 1, &end, 0);
+  if (*end == 'k' || *end == 'K') {
+    value <<= 10;
+    end++;
+  }
+  if (end == colon + 1 || *end != '\0' || value == 0) {
+    return -1;
+  }
+  if (strncmp(arg, "granule:", colon - arg + 1) == 0) {
+    if (!is_power_of_two(value) || value > MEMORY_SPACE) {
+      return -1;
+    }
+    granule = value;
+  } else if (strncmp(arg, "window:", colon - arg + 1) == 0) {
+    window_length = value;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/* Starts counting accesses. Returns 0 on success. */
+int heatmap_open(const char *filename) {
+  static int registered;
+
+  for (granule_bits = 0; (1U << granule_bits) < granule; granule_bits++) {
+  }
+  granules = MEMORY_SPACE >> granule_bits;
+  heatmap_filename = strdup(filename);
+  reads = calloc(granules, sizeof(*reads));
+  writes = calloc(granules, sizeof(*writes));
+  stamps = calloc(granules, sizeof(*stamps));
+  if (heatmap_filename == NULL || reads == NULL || writes == NULL ||
+      stamps == NULL) {
+    fprintf(stderr, "Out of memory for the heatmap\n");
+    return -1;
+  }
+  window_count = 0;
+  window_end = retired + window_length;
+  working_set = footprint = 0;
+  loads = stores = 0;
+  heatmap_enabled = 1;
+  if (!registered) {
+    atexit(heatmap_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+/* Closes windows until the one holding instruction number now */
+static void advance(Double now) {
+  while (now >= window_end) {
+    if (window_count == window_size) {
+      window_size = window_size ? 2 * window_size : 1024;
+      windows = realloc(windows, window_size * sizeof(*windows));
+      if (windows == NULL) {
+        fprintf(stderr, "Out of memory for the heatmap\n");
+        exit(-1);
+      }
+    }
+    windows[window_count].working_set = working_set;
+    windows[window_count].footprint = footprint;
+    window_count++;
+    working_set = 0;
+    window_end += window_length;
+  }
+}
+
+static void touch(Word slot, int write) {
+  if (write) {
+    writes[slot]++;
+  } else {
+    reads[slot]++;
+  }
+  /* stamps are window numbers plus one, so 0 means never touched */
+  if (stamps[slot] != window_count + 1) {
+    footprint += stamps[slot] == 0;
+    stamps[slot] = window_count + 1;
+    working_set++;
+  }
+}
+
+/* Records a load or store of size bytes at address */
+void heatmap_access(Address address, Word size, int write) {
+  Word first = address >> granule_bits;
+  Word last = (address + size - 1) >> granule_bits;
+  Word slot;
+
+  if (retired >= window_end) {
+    advance(retired);
+  }
+  if (last >= granules) {
+    return;
+  }
+  if (write) {
+    stores++;
+  } else {
+    loads++;
+  }
+  /* granules smaller than the access are all touched by it */
+  for (slot = first; slot <= last; slot++) {
+    touch(slot, write);
+  }
+}
+
+/* 0 for no accesses, else 1 to HEAT_LEVELS - 1 on a log scale up to max */
+static int heat(Double count, Double max) {
+  int bits = 0, max_bits = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+  while (count >>= 1) {
+    bits++;
+  }
+  while (max >>= 1) {
+    max_bits++;
+  }
+  return 1 + bits * (int)(HEAT_LEVELS - 2) / (max_bits ? max_bits : 1);
+}
+
+static int compare_granules(const void *a, const void *b) {
+  Word x = *(const Word *)a, y = *(const Word *)b;
+  Double cx = reads[x] + writes[x], cy = reads[y] + writes[y];
+
+  return cx < cy ? 1 : cx > cy ? -1 : x < y ? -1 : x > y;
+}
+
+static void write_heatmap(FILE *out, Double max) {
+  Word row, i;
+  int skipped = 0, empty;
+
+  fprintf(out, "\nHeatmap, %u bytes per row, scale \"%s\"\n",
+          HEATMAP_ROW * granule, heat_scale);
+  for (row = 0; row < granules; row += HEATMAP_ROW) {
+    empty = 1;
+    for (i = row; i < row + HEATMAP_ROW && i < granules; i++) {
+      empty = empty && reads[i] + writes[i] == 0;
+    }
+    /* print one line for each run of untouched rows */
+    if (empty) {
+      if (!skipped) {
+        fprintf(out, "%8s\n", "...");
+      }
+      skipped = 1;
+      continue;
+    }
+    skipped = 0;
+    fprintf(out, "%08x |", row << granule_bits);
+    for (i = row; i < row + HEATMAP_ROW && i < granules; i++) {
+      fputc(heat_scale[heat(reads[i] + writes[i], max)], out);
+    }
+    fprintf(out, "|\n");
+  }
+}
+
+static void write_report(FILE *out) {
+  Double total_reads = 0, total_writes = 0, max = 0;
+  Word *slots, count = 0, peak = 0, slot, i;
+
+  for (slot = 0; slot < granules; slot++) {
+    total_reads += reads[slot];
+    total_writes += writes[slot];
+    if (reads[slot] + writes[slot] > max) {
+      max = reads[slot] + writes[slot];
+    }
+  }
+  for (i = 0; i < window_count; i++) {
+    if (windows[i].working_set > peak) {
+      peak = windows[i].working_set;
+    }
+  }
+  fprintf(out, "granule %u bytes, window %u instructions\n", granule,
+          window_length);
+  fprintf(out, "%llu loads, %llu stores\n", (unsigned long long)loads,
+          (unsigned long long)stores);
+  fprintf(out, "footprint %u granules (%u bytes)\n", footprint,
+          footprint * granule);
+  fprintf(out, "peak working set %u granules (%u bytes) in %u windows\n",
+          peak, peak * granule, window_count);
+  write_heatmap(out, max);
+
+  slots = malloc((footprint + 1) * sizeof(*slots));
+  if (slots == NULL) {
+    fprintf(stderr, "Out of memory for the heatmap report\n");
+    exit(-1);
+  }
+  for (slot = 0; slot < granules; slot++) {
+    if (stamps[slot]) {
+      slots[count++] = slot;
+    }
+  }
+  qsort(slots, count, sizeof(*slots), compare_granules);
+  fprintf(out, "\nHot granules\n");
+  fprintf(out, "%-8s %14s %14s %7s\n", "address", "loads", "stores",
+          "access%");
+  for (i = 0; i < count && i < HEATMAP_TOP; i++) {
+    slot = slots[i];
+    fprintf(out, "%08x %14llu %14llu %6.2f%%\n", slot << granule_bits,
+            (unsigned long long)reads[slot], (unsigned long long)writes[slot],
+            100.0 * (reads[slot] + writes[slot]) /
+                (total_reads + total_writes));
+  }
+  free(slots);
+}
+
+static void write_curve(FILE *out) {
+  Word i;
+
+  fprintf(out, "# instruction working_set_bytes footprint_bytes\n");
+  for (i = 0; i < window_count; i++) {
+    fprintf(out, "%llu %u %u\n", (unsigned long long)i * window_length,
+            windows[i].working_set * granule, windows[i].footprint * granule);
+  }
+}
+
+/* Writes the report and the working-set curve. Called at exit. */
+void heatmap_close(void) {
+  char *curve;
+  FILE *out;
+
+  if (reads == NULL) {
+    return;
+  }
+  heatmap_enabled = 0;
+  /* close the windows up to the end of the run, the last one partial */
+  advance(retired);
+  if (retired > window_end - window_length) {
+    advance(window_end);
+  }
+  out = fopen(heatmap_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create heatmap %s\n", heatmap_filename);
+  } else {
+    write_report(out);
+    fclose(out);
+  }
+
+  curve = malloc(strlen(heatmap_filename) + sizeof(".ws"));
+  if (curve != NULL) {
+    sprintf(curve, "%s.ws", heatmap_filename);
+    out = fopen(curve, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Cannot create heatmap %s\n", curve);
+    } else {
+      write_curve(out);
+      fclose(out);
+    }
+    free(curve);
+  }
+
+  free(reads);
+  free(writes);
+  free(stamps);
+  free(windows);
+  free(heatmap_filename);
+  reads = writes = NULL;
+  stamps = NULL;
+  windows = NULL;
+  window_size = 0;
+  heatmap_filename = NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "types.h"
+
+/* Memory access heatmap (--heatmap=FILE). Counts the loads and stores that
+   touch each granule of guest memory, a page or a cache line, and the
+   number of distinct granules touched in each window of retired
+   instructions. Set with --heatmap-config=NAME:VALUE, where NAME is
+   granule (bytes, a power of two) or window (instructions). At exit FILE
+   gets the totals, a log-scale heatmap of the address space and the
+   hottest granules, and FILE.ws the working-set curve: one line per window
+   with its first instruction, its working set and the footprint so far,
+   both in bytes.
+
+   When it is off, load() and store() test heatmap_enabled and do nothing
+   else. */
+#define HEATMAP_DEFAULT_GRANULE 4096
+#define HEATMAP_DEFAULT_WINDOW 100000
+#define HEATMAP_ROW 64 /* granules per heatmap row */
+#define HEATMAP_TOP 40
+
+extern int heatmap_enabled;
+
+int heatmap_configure(const char *arg);
+int heatmap_open(const char *filename);
+void heatmap_access(Address address, Word size, int write);
+void heatmap_close(void);
+
+#endif
@@ -0,0 +1,145 @@
+#include "image.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_PAGE_SIZE 4096
+
+/* Returns 1 if filename starts with the image magic */
+int image_is_image(const char *filename) {
+  char magic[sizeof(IMAGE_MAGIC) - 1];
+  FILE *file = fopen(filename, "rb");
+  int is_image;
+
+  if (file == NULL) {
+    return 0;
+  }
+  is_image = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+             memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+  fclose(file);
+  return is_image;
+}
+
+/* Writes the numins words at base together with their predecoded form */
+int image_write(const char *filename, const Byte *memory, Address base,
+                Word numins) {
+  ImageHeader header;
+  DecodedInstruction *table;
+  static const Byte zeroes[IMAGE_PAGE_SIZE];
+  FILE *file;
+  size_t padding;
+  int ok;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+  header.version = IMAGE_VERSION;
+  header.entry_size = sizeof(DecodedInstruction);
+  header.base = base;
+  header.numins = numins;
+  header.mem_offset = sizeof(header);
+  header.mem_size = numins * 4;
+  header.decode_offset = (header.mem_offset + header.mem_size +
+                          IMAGE_PAGE_SIZE - 1) & ~(IMAGE_PAGE_SIZE - 1);
+  header.decode_count = numins;
+  padding = header.decode_offset - header.mem_offset - header.mem_size;
+
+  table = malloc(numins * sizeof(DecodedInstruction) + 1);
+  if (table == NULL) {
+    fprintf(stderr, "Out of memory writing image %s\n", filename);
+    return -1;
+  }
+  predecode_range(table, memory, base, numins);
+
+  file = fopen(filename, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot create image %s\n", filename);
+    free(table);
+    return -1;
+  }
+  ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+       fwrite(memory + base, 1, header.mem_size, file) == header.mem_size &&
+       fwrite(zeroes, 1, padding, file) == padding &&
+       fwrite(table, sizeof(DecodedInstruction), numins, file) == numins;
+  ok = fclose(file) == 0 && ok;
+  free(table);
+
+  if (!ok) {
+    fprintf(stderr, "Error writing image %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/* Maps an image read-only. Returns 0 on success and -1 (after reporting the
+ * problem) if the file is missing or is not a valid image. */
+int image_open(const char *filename, Image *image) {
+  struct stat st;
+  const ImageHeader *header;
+  int fd = open(filename, O_RDONLY);
+
+  memset(image, 0, sizeof(*image));
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Cannot open image %s\n", filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(ImageHeader)) {
+    fprintf(stderr, "Truncated image %s\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  image->map_size = st.st_size;
+  image->map = mmap(NULL, image->map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image->map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map image %s\n", filename);
+    image->map = NULL;
+    return -1;
+  }
+
+  header = image->map;
+  if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != IMAGE_VERSION ||
+      header->entry_size != sizeof(DecodedInstruction) ||
+      (size_t)header->mem_offset + header->mem_size > image->map_size ||
+      header->decode_offset % sizeof(Word) != 0 ||
+      (size_t)header->decode_offset +
+              (size_t)header->decode_count * sizeof(DecodedInstruction) >
+          image->map_size) {
+    fprintf(stderr, "Bad or incompatible image %s\n", filename);
+    image_close(image);
+    return -1;
+  }
+
+  image->header = header;
+  image->mem = (const Byte *)image->map + header->mem_offset;
+  image->cache.entries =
+      (const DecodedInstruction *)((const Byte *)image->map +
+                                   header->decode_offset);
+  image->cache.base = header->base;
+  image->cache.count = header->decode_count;
+  return 0;
+}
+
+/* Copies the memory image into guest memory */
+void image_load(const Image *image, Byte *memory, size_t memsize) {
+  if ((size_t)image->header->base + image->header->mem_size > memsize) {
+    fprintf(stderr, "Image does not fit in memory\n");
+    exit(-1);
+  }
+  memcpy(memory + image->header->base, image->mem, image->header->mem_size);
+}
+
+void image_close(Image *image) {
+  if (image->map != NULL) {
+    munmap(image->map, image->map_size);
+  }
+  memset(image, 0, sizeof(*image));
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include "decode.h"
+#include "types.h"
+
+/* A precompiled program image (.rvimg). The file is laid out as
+
+     ImageHeader | memory image | padding | DecodedInstruction[decode_count]
+
+   with the decode table starting on a page boundary, so that it can be
+   mmap'd read-only and shared between every process running the image.
+   All fields are stored in host byte order. */
+#define IMAGE_MAGIC "RVIMG\0\0\0"
+#define IMAGE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  Word version;
+  Word entry_size;    /* sizeof(DecodedInstruction) when written */
+  Address base;       /* guest address of the memory image */
+  Word numins;        /* instructions in the original program */
+  Word mem_offset;    /* file offset of the memory image */
+  Word mem_size;      /* length of the memory image in bytes */
+  Word decode_offset; /* file offset of the decode table */
+  Word decode_count;  /* entries in the decode table */
+} ImageHeader;
+
+/* A mapped image, see image_open() */
+typedef struct {
+  const ImageHeader *header;
+  const Byte *mem;
+  DecodeCache cache;
+  void *map;
+  size_t map_size;
+} Image;
+
+int image_is_image(const char *filename);
+int image_write(const char *filename, const Byte *memory, Address base,
+                Word numins);
+int image_open(const char *filename, Image *image);
+void image_load(const Image *image, Byte *memory, size_t memsize);
+void image_close(Image *image);
+
+#endif
@@ -0,0 +1,205 @@
+#include "lockstep.h"
+#include "event.h"
+#include "riscv.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The reference side, for checking the final state if an ecall exits */
+static const Processor *ref_processor;
+static const Byte *ref_memory;
+
+/* The predecoded engine's copy of the machine */
+static Processor alt;
+static Byte *alt_memory;
+static DecodeCache alt_cache;
+static DecodedInstruction *alt_entries;
+
+static Double interval;
+static Double executed;   /* instructions run on both engines */
+static Double checked;    /* instructions up to the last passing check */
+static Double ref_writes; /* hashes of every memory write so far */
+static Double alt_writes;
+static RetireEvent ref_event, alt_event; /* the last instruction of each */
+
+/* Folds a memory write into a running FNV-1a style hash. The value is read
+ * back from memory, so a store that went to the wrong address or wrote the
+ * wrong bytes changes the hash. */
+static Double hash_write(Double hash, const RetireEvent *event,
+                         Byte *memory) {
+  Word value = load(memory, event->mem_addr, event->mem_size);
+  Double word = (Double)event->mem_addr << 32 | value;
+
+  hash = (hash ^ word ^ event->mem_size) * 0x100000001b3ULL;
+  return hash ^ (hash >> 29);
+}
+
+static void lockstep_release(void) {
+  free(alt_memory);
+  free(alt_entries);
+  alt_memory = NULL;
+  alt_entries = NULL;
+}
+
+static void lockstep_exit(void) {
+  if (alt_memory != NULL && lockstep_finish(ref_processor, ref_memory) != 0) {
+    fflush(stdout);
+    _exit(EXIT_FAILURE);
+  }
+}
+
+int lockstep_init(const Processor *processor, const Byte *memory,
+                  const DecodeCache *cache, Address base, Word numins,
+                  Double every) {
+  static int registered;
+
+  ref_processor = processor;
+  ref_memory = memory;
+  alt = *processor;
+  alt_memory = malloc(MEMORY_SPACE);
+  if (alt_memory == NULL) {
+    fprintf(stderr, "Out of memory for lockstep execution\n");
+    return -1;
+  }
+  memcpy(alt_memory, memory, MEMORY_SPACE);
+
+  /* decode the program here unless an image brought its own table */
+  if (cache->count > 0) {
+    alt_cache = *cache;
+  } else {
+    alt_entries = malloc((numins ? numins : 1) * sizeof(*alt_entries));
+    if (alt_entries == NULL) {
+      fprintf(stderr, "Out of memory for lockstep execution\n");
+      return -1;
+    }
+    predecode_range(alt_entries, alt_memory, base, numins);
+    alt_cache.entries = alt_entries;
+    alt_cache.base = base;
+    alt_cache.count = numins;
+  }
+
+  interval = every ? every : LOCKSTEP_DEFAULT_INTERVAL;
+  executed = checked = 0;
+  ref_writes = alt_writes = 0;
+  if (!registered) {
+    atexit(lockstep_exit);
+    registered = 1;
+  }
+  return 0;
+}
+
+static void print_instruction(const char *label, const RetireEvent *event) {
+  char line[DISASM_LINE_MAX];
+
+  format_instruction(line, sizeof(line), event->bits);
+  fprintf(stderr, "  %s %08x: %08x %s", label, event->pc, event->bits, line);
+  if (event->mem_write) {
+    fprintf(stderr, "    wrote %u bytes of %08x at %08x\n", event->mem_size,
+            event->mem_value, event->mem_addr);
+  }
+}
+
+/* Reports what differs between the two engines */
+static void report(const Processor *processor) {
+  int i;
+
+  if (checked + 1 == executed) {
+    fprintf(stderr, "lockstep: engines diverged at instruction %llu\n",
+            (unsigned long long)checked);
+  } else {
+    fprintf(stderr,
+            "lockstep: engines diverged between instructions %llu and %llu\n",
+            (unsigned long long)checked, (unsigned long long)executed - 1);
+  }
+  print_instruction("reference", &ref_event);
+  print_instruction("decoded  ", &alt_event);
+  if (processor->PC != alt.PC) {
+    fprintf(stderr, "  pc: reference %08x, decoded %08x\n", processor->PC,
+            alt.PC);
+  }
+  for (i = 0; i < 32; i++) {
+    if (processor->R[i] != alt.R[i]) {
+      fprintf(stderr, "  x%d: reference %08x, decoded %08x\n", i,
+              processor->R[i], alt.R[i]);
+    }
+  }
+  if (ref_writes != alt_writes) {
+    fprintf(stderr, "  memory writes differ\n");
+  }
+}
+
+static int check(const Processor *processor) {
+  if (processor->PC != alt.PC || ref_writes != alt_writes ||
+      memcmp(processor->R, alt.R, sizeof(alt.R)) != 0) {
+    report(processor);
+    return -1;
+  }
+  checked = executed;
+  return 0;
+}
+
+/* Runs the next instruction on both engines. Returns -1 if they have
+ * diverged by the end of this check interval. */
+int lockstep_step(Processor *processor, Byte *memory) {
+  const DecodedInstruction *decoded;
+  Word bits = load(memory, processor->PC, LENGTH_WORD);
+  Word alt_bits = load(alt_memory, alt.PC, LENGTH_WORD);
+
+  event_begin(&ref_event, processor->PC, bits, processor);
+  event_begin(&alt_event, alt.PC, alt_bits, &alt);
+
+  execute_instruction(bits, processor, memory);
+  processor->R[0] = 0;
+
+  if ((alt_bits & 0x7f) == 0x73) {
+    /* ecalls have no architectural effect besides the pc, and the counters
+       a csr instruction reads belong to the reference side */
+    if (alt_bits >> 12 & 0x7) {
+      alt.R[alt_bits >> 7 & 0x1f] = processor->R[alt_bits >> 7 & 0x1f];
+    }
+    alt.PC += 4;
+  } else {
+    decoded = decode_cache_lookup(&alt_cache, alt.PC, alt_bits);
+    if (decoded != NULL) {
+      execute_decoded(decoded, &alt, alt_memory);
+    } else {
+      execute_instruction(alt_bits, &alt, alt_memory);
+    }
+    alt.R[0] = 0;
+  }
+
+  if (ref_event.mem_write) {
+    ref_writes = hash_write(ref_writes, &ref_event, memory);
+  }
+  if (alt_event.mem_write) {
+    alt_writes = hash_write(alt_writes, &alt_event, alt_memory);
+  }
+  if (++executed - checked >= interval && check(processor) != 0) {
+    lockstep_release();
+    return -1;
+  }
+  return 0;
+}
+
+/* Checks the final state, including all of memory. Returns 0 if the two
+ * engines agree. */
+int lockstep_finish(const Processor *processor, const Byte *memory) {
+  int status = 0;
+
+  if (executed != checked) {
+    status = check(processor);
+  }
+  if (status == 0 && memcmp(memory, alt_memory, MEMORY_SPACE) != 0) {
+    fprintf(stderr, "lockstep: memory differs after %llu instructions\n",
+            (unsigned long long)executed);
+    status = -1;
+  }
+  if (status == 0) {
+    fprintf(stderr, "lockstep: %llu instructions, engines agree\n",
+            (unsigned long long)executed);
+  }
+  lockstep_release();
+  return status;
+}
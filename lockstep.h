@@ -0,0 +1,22 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "decode.h"
+#include "types.h"
+
+/* Lockstep differential execution (--lockstep). The reference interpreter,
+   execute_instruction() in part2.c, runs on the simulator's processor and
+   memory; the predecoded engine runs on private copies of both. Every
+   interval instructions the registers, PC and a running hash of the memory
+   writes of the two are compared, and the run stops at the first check
+   that fails. Ecalls only run on the reference side, so console output and
+   exits happen once. */
+#define LOCKSTEP_DEFAULT_INTERVAL 1
+
+int lockstep_init(const Processor *processor, const Byte *memory,
+                  const DecodeCache *cache, Address base, Word numins,
+                  Double interval);
+int lockstep_step(Processor *processor, Byte *memory);
+int lockstep_finish(const Processor *processor, const Byte *memory);
+
+#endif
@@ -0,0 +1,431 @@
+#include "ooo.h"
+#include "ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OOO_MAX_UNITS 8
+#define OOO_STORE_SLOTS 1024    /* recent stores tracked for forwarding */
+#define OOO_INDIRECT_SLOTS 1024 /* last targets of indirect jumps */
+#define OOO_RAS_DEPTH 16
+
+enum {
+  PARAM_WIDTH,
+  PARAM_ROB,
+  PARAM_IQ,
+  PARAM_LQ,
+  PARAM_SQ,
+  PARAM_ALU,
+  PARAM_LSU,
+  PARAM_LOAD,
+  PARAM_MUL,
+  PARAM_DIV,
+  PARAM_MISPREDICT,
+  PARAM_THREAD,
+  PARAM_COUNT
+};
+
+enum {
+  STALL_MISPREDICT,
+  STALL_ROB,
+  STALL_IQ,
+  STALL_LQ,
+  STALL_SQ,
+  STALL_OPERANDS,
+  STALL_UNITS,
+  STALL_KINDS
+};
+
+enum { UNIT_ALU, UNIT_LSU, UNIT_MUL, UNIT_DIV, UNIT_KINDS };
+
+static const char *const param_names[PARAM_COUNT] = {
+    "width", "rob", "iq",  "lq",  "sq",         "alu",
+    "lsu",   "load", "mul", "div", "mispredict", "thread"};
+static int params[PARAM_COUNT] = {4, 128, 32, 32, 24, 3, 2, 3, 3, 20, 8, 1};
+static const int param_min[PARAM_COUNT] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0};
+static const int param_max[PARAM_COUNT] = {
+    16, 4096, 4096, 4096, 4096, OOO_MAX_UNITS, OOO_MAX_UNITS,
+    1000, 1000, 1000, 1000, 1};
+
+static const char *const stall_names[STALL_KINDS] = {
+    "mispredict", "rob full", "iq full",   "lq full",
+    "sq full",    "operands", "functional units"};
+
+static char *ooo_filename;
+static OooOp batch[OOO_BATCH];
+static int batch_count;
+
+/* the model thread, when there is one */
+static int ooo_threaded;
+static int ooo_stopping;
+static Ring ooo_ring;
+static pthread_t ooo_thread;
+
+/* model state, only touched by whichever thread runs the model */
+static Double *rob_retire; /* retire cycle of the last rob instructions */
+static Double *iq_issue;   /* issue cycle of the last iq instructions */
+static Double *lq_retire, *sq_retire;
+static Double instructions, loads, stores;
+static Double fetch_cycle, fetch_resume;
+static int fetch_count;
+static Double dispatch_cycle;
+static int dispatch_count;
+static Double retire_cycle;
+static int retire_count;
+static Double ready[32];
+static Double unit_free[UNIT_KINDS][OOO_MAX_UNITS];
+static Address store_addr[OOO_STORE_SLOTS];
+static Double store_done[OOO_STORE_SLOTS];
+static Byte counters[1 << OOO_PREDICTOR_BITS];
+static Address indirect[OOO_INDIRECT_SLOTS];
+static Address ras[OOO_RAS_DEPTH];
+static int ras_top, ras_count;
+static Double branches, mispredicts;
+static Double stalls[STALL_KINDS];
+
+/* Parses NAME:VALUE, such as rob:64 or thread:0. Returns 0 on success. */
+int ooo_configure(const char *arg) {
+  const char *colon = strchr(arg, ':');
+  char *end;
+  long value;
+  int i;
+
+  if (colon == NULL) {
+    return -1;
+  }
+  value = strtol(colon + 1, &end, 0);
+  if (end == colon + 1 || *end != '\0') {
+    return -1;
+  }
+  for (i = 0; i < PARAM_COUNT; i++) {
+    if (strlen(param_names[i]) == (size_t)(colon - arg) &&
+        strncmp(arg, param_names[i], colon - arg) == 0) {
+      if (value < param_min[i] || value > param_max[i]) {
+        return -1;
+      }
+      params[i] = value;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static Double later(Double a, Double b) { return a > b ? a : b; }
+
+/* Delays *cycle to at least limit, charging the delay to a stall kind */
+static void wait_for(Double *cycle, Double limit, int kind) {
+  if (limit > *cycle) {
+    stalls[kind] += limit - *cycle;
+    *cycle = limit;
+  }
+}
+
+/* Picks the unit of a kind that frees up first and issues on it no
+ * earlier than cycle. Returns the issue cycle. */
+static Double issue_on(int kind, int units, Double cycle, Double busy) {
+  Double *free_at = unit_free[kind];
+  int i, best = 0;
+
+  for (i = 1; i < units; i++) {
+    if (free_at[i] < free_at[best]) {
+      best = i;
+    }
+  }
+  wait_for(&cycle, free_at[best], STALL_UNITS);
+  free_at[best] = cycle + busy;
+  return cycle;
+}
+
+static int is_link(int reg) { return reg == 1 || reg == 5; }
+
+/* Returns 1 if the front end would have fetched down the wrong path */
+static int mispredicted(const OooOp *op, int rd, int rs1) {
+  Word opcode = op->bits & 0x7f;
+  Byte *counter;
+  Address *target;
+  int taken, wrong = 0;
+
+  switch (opcode) {
+  case 0x63:
+    taken = op->next_pc != op->pc + 4;
+    counter = &counters[(op->pc >> 2) & ((1 << OOO_PREDICTOR_BITS) - 1)];
+    wrong = (*counter >= 2) != taken;
+    if (taken && *counter < 3) {
+      (*counter)++;
+    } else if (!taken && *counter > 0) {
+      (*counter)--;
+    }
+    branches++;
+    break;
+  case 0x67:
+    if (rd == 0 && is_link(rs1)) {
+      wrong = ras_count == 0 || ras[ras_top] != op->next_pc;
+      if (ras_count > 0) {
+        ras_top = (ras_top + OOO_RAS_DEPTH - 1) % OOO_RAS_DEPTH;
+        ras_count--;
+      }
+    } else {
+      target = &indirect[(op->pc >> 2) % OOO_INDIRECT_SLOTS];
+      wrong = *target != op->next_pc;
+      *target = op->next_pc;
+    }
+    branches++;
+    break;
+  }
+  if ((opcode == 0x6f || opcode == 0x67) && is_link(rd)) {
+    ras_top = (ras_top + 1) % OOO_RAS_DEPTH;
+    ras[ras_top] = op->pc + 4;
+    if (ras_count < OOO_RAS_DEPTH) {
+      ras_count++;
+    }
+  }
+  mispredicts += wrong;
+  return wrong;
+}
+
+/* Works out when one instruction is fetched, dispatched, issued, completes
+ * and retires. Instructions are placed in program order, each as early as
+ * the ones before it and the core's resources allow. */
+static void model_op(const OooOp *op) {
+  Word opcode = op->bits & 0x7f, funct3 = op->bits >> 12 & 0x7;
+  int width = params[PARAM_WIDTH];
+  int rd = event_destination(op->bits), rs1, rs2;
+  int is_load = opcode == 0x03, is_store = opcode == 0x23;
+  int is_mul = opcode == 0x33 && op->bits >> 25 == 0x1;
+  Double dispatch, issue, complete, retire;
+  Word slot;
+
+  /* fetch, width a cycle, none while a misprediction is being resolved */
+  if (fetch_count == width) {
+    fetch_cycle++;
+    fetch_count = 0;
+  }
+  if (fetch_resume > fetch_cycle) {
+    stalls[STALL_MISPREDICT] += fetch_resume - fetch_cycle;
+    fetch_cycle = fetch_resume;
+    fetch_count = 0;
+  }
+  fetch_count++;
+
+  /* dispatch in order into the rob, the issue queue and a load or store
+     queue entry */
+  dispatch = later(fetch_cycle + OOO_FRONTEND, dispatch_cycle);
+  if (dispatch == dispatch_cycle && dispatch_count == width) {
+    dispatch++;
+  }
+  if (instructions >= (Double)params[PARAM_ROB]) {
+    wait_for(&dispatch, rob_retire[instructions % params[PARAM_ROB]],
+             STALL_ROB);
+  }
+  if (instructions >= (Double)params[PARAM_IQ]) {
+    wait_for(&dispatch, iq_issue[instructions % params[PARAM_IQ]], STALL_IQ);
+  }
+  if (is_load && loads >= (Double)params[PARAM_LQ]) {
+    wait_for(&dispatch, lq_retire[loads % params[PARAM_LQ]], STALL_LQ);
+  }
+  if (is_store && stores >= (Double)params[PARAM_SQ]) {
+    wait_for(&dispatch, sq_retire[stores % params[PARAM_SQ]], STALL_SQ);
+  }
+  if (dispatch != dispatch_cycle) {
+    dispatch_cycle = dispatch;
+    dispatch_count = 0;
+  }
+  dispatch_count++;
+
+  /* issue once the operands are ready and a unit is free */
+  event_sources(op->bits, &rs1, &rs2);
+  issue = dispatch + 1;
+  wait_for(&issue, later(ready[rs1], ready[rs2]), STALL_OPERANDS);
+  slot = (op->mem_addr >> 2) % OOO_STORE_SLOTS;
+  if (is_load && store_addr[slot] == ((op->mem_addr & ~3U) | 1)) {
+    wait_for(&issue, store_done[slot], STALL_OPERANDS);
+  }
+  if (is_load || is_store) {
+    issue = issue_on(UNIT_LSU, params[PARAM_LSU], issue, 1);
+    complete = issue + (is_load ? params[PARAM_LOAD] : 1);
+  } else if (is_mul && funct3 >= 4) {
+    issue = issue_on(UNIT_DIV, 1, issue, params[PARAM_DIV]);
+    complete = issue + params[PARAM_DIV];
+  } else if (is_mul) {
+    issue = issue_on(UNIT_MUL, 1, issue, 1);
+    complete = issue + params[PARAM_MUL];
+  } else {
+    issue = issue_on(UNIT_ALU, params[PARAM_ALU], issue, 1);
+    complete = issue + 1;
+  }
+  iq_issue[instructions % params[PARAM_IQ]] = issue;
+  if (is_store) {
+    store_addr[slot] = (op->mem_addr & ~3U) | 1; /* never an empty slot */
+    store_done[slot] = complete;
+  }
+  if (rd != 0) {
+    ready[rd] = complete;
+  }
+
+  /* the front end restarts once a mispredicted transfer has executed */
+  if (mispredicted(op, rd, rs1)) {
+    fetch_resume = complete + params[PARAM_MISPREDICT];
+  }
+
+  /* retire in order, width a cycle */
+  retire = later(complete + 1, retire_cycle);
+  if (retire == retire_cycle && retire_count == width) {
+    retire++;
+  }
+  if (retire != retire_cycle) {
+    retire_cycle = retire;
+    retire_count = 0;
+  }
+  retire_count++;
+  rob_retire[instructions % params[PARAM_ROB]] = retire;
+  if (is_load) {
+    lq_retire[loads++ % params[PARAM_LQ]] = retire;
+  }
+  if (is_store) {
+    sq_retire[stores++ % params[PARAM_SQ]] = retire;
+  }
+  instructions++;
+}
+
+/* Runs the model on the ops the simulator hands over */
+static void *ooo_worker(void *arg) {
+  const void *data;
+  size_t len, i;
+
+  for (;;) {
+    len = ring_peek(&ooo_ring, &data);
+    if (len >= sizeof(OooOp)) {
+      len -= len % sizeof(OooOp);
+      for (i = 0; i < len / sizeof(OooOp); i++) {
+        model_op((const OooOp *)data + i);
+      }
+      ring_consume(&ooo_ring, len);
+    } else if (__atomic_load_n(&ooo_stopping, __ATOMIC_ACQUIRE)) {
+      if (ring_empty(&ooo_ring)) {
+        break;
+      }
+    } else {
+      usleep(50);
+    }
+  }
+  return NULL;
+}
+
+/* Starts the model, on its own thread unless thread:0 was given. Returns 0
+ * on success. */
+int ooo_open(const char *filename) {
+  static int registered;
+
+  ooo_filename = strdup(filename);
+  rob_retire = calloc(params[PARAM_ROB], sizeof(*rob_retire));
+  iq_issue = calloc(params[PARAM_IQ], sizeof(*iq_issue));
+  lq_retire = calloc(params[PARAM_LQ], sizeof(*lq_retire));
+  sq_retire = calloc(params[PARAM_SQ], sizeof(*sq_retire));
+  if (ooo_filename == NULL || rob_retire == NULL || iq_issue == NULL ||
+      lq_retire == NULL || sq_retire == NULL) {
+    fprintf(stderr, "Out of memory for the out-of-order model\n");
+    return -1;
+  }
+  memset(counters, 1, sizeof(counters)); /* weakly not taken */
+  batch_count = 0;
+  ooo_threaded = params[PARAM_THREAD];
+  if (ooo_threaded) {
+    if (ring_init(&ooo_ring, OOO_RING_SIZE) != 0 ||
+        pthread_create(&ooo_thread, NULL, ooo_worker, NULL) != 0) {
+      fprintf(stderr, "Cannot start the out-of-order model thread\n");
+      return -1;
+    }
+  }
+  if (!registered) {
+    atexit(ooo_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+static void flush_batch(void) {
+  int i;
+
+  if (!ooo_threaded) {
+    for (i = 0; i < batch_count; i++) {
+      model_op(&batch[i]);
+    }
+  } else {
+    while (!ring_push(&ooo_ring, batch, batch_count * sizeof(*batch))) {
+      sched_yield();
+    }
+  }
+  batch_count = 0;
+}
+
+/* Queues a retired instruction for the model */
+void ooo_retire(const RetireEvent *event) {
+  OooOp *op = &batch[batch_count];
+
+  op->pc = event->pc;
+  op->bits = event->bits;
+  op->next_pc = event->next_pc;
+  op->mem_addr = event->mem_size ? event->mem_addr : 0;
+  if (++batch_count == OOO_BATCH) {
+    flush_batch();
+  }
+}
+
+static void write_report(FILE *out) {
+  Double cycles = instructions ? retire_cycle + 1 : 0;
+  int i;
+
+  fprintf(out, "%llu instructions, %llu cycles, IPC %.3f\n",
+          (unsigned long long)instructions, (unsigned long long)cycles,
+          cycles ? (double)instructions / cycles : 0.0);
+  fprintf(out, "core:");
+  for (i = 0; i < PARAM_THREAD; i++) {
+    fprintf(out, " %s %d", param_names[i], params[i]);
+  }
+  fprintf(out, "\n%llu branches and indirect jumps, %llu mispredicted "
+               "(%.2f%%)\n",
+          (unsigned long long)branches, (unsigned long long)mispredicts,
+          branches ? 100.0 * mispredicts / branches : 0.0);
+
+  fprintf(out, "\nStalls (cycles an instruction waited)\n");
+  for (i = 0; i < STALL_KINDS; i++) {
+    fprintf(out, "%-17s %14llu %8.3f per instruction\n", stall_names[i],
+            (unsigned long long)stalls[i],
+            instructions ? (double)stalls[i] / instructions : 0.0);
+  }
+}
+
+/* Drains the queue and writes the report. Called at exit. */
+void ooo_close(void) {
+  FILE *out;
+
+  if (rob_retire == NULL) {
+    return;
+  }
+  flush_batch();
+  if (ooo_threaded) {
+    __atomic_store_n(&ooo_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(ooo_thread, NULL);
+    ring_destroy(&ooo_ring);
+    ooo_threaded = 0;
+    ooo_stopping = 0;
+  }
+
+  out = fopen(ooo_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create out-of-order report %s\n", ooo_filename);
+  } else {
+    write_report(out);
+    fclose(out);
+  }
+  free(rob_retire);
+  free(iq_issue);
+  free(lq_retire);
+  free(sq_retire);
+  free(ooo_filename);
+  rob_retire = iq_issue = lq_retire = sq_retire = NULL;
+  ooo_filename = NULL;
+}
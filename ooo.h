@@ -0,0 +1,40 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include "event.h"
+#include "types.h"
+
+/* Out-of-order core timing model (--ooo=FILE). Retired instructions are
+   replayed, in program order, through a core that fetches and dispatches
+   width instructions a cycle into a reorder buffer, waits in an issue queue
+   for its operands and a free functional unit, and retires width a cycle.
+   Loads and stores also hold load or store queue entries until they
+   retire, and a load waits for an older store to the same word. Branches
+   are predicted with a bimodal table and returns with a return-address
+   stack; a misprediction stops fetch until the branch executes. Sizes and
+   latencies are set with --ooo-config=NAME:VALUE.
+
+   The model normally runs on its own thread. The simulator packs each
+   instruction into an OooOp and hands them over in batches through a Ring;
+   thread:0 runs the model inline instead. At exit FILE gets the IPC and the
+   cycles lost to each kind of stall. */
+#define OOO_BATCH 256                  /* ops handed over at a time */
+#define OOO_RING_SIZE (1 << 20)        /* bytes */
+#define OOO_FRONTEND 3                 /* cycles from fetch to dispatch */
+#define OOO_PREDICTOR_BITS 12
+
+/* One retired instruction, as the model sees it. The size is a power of
+   two so that ops never wrap around the end of the ring. */
+typedef struct {
+  Address pc;
+  Word bits;
+  Address next_pc;
+  Address mem_addr;
+} OooOp;
+
+int ooo_configure(const char *arg);
+int ooo_open(const char *filename);
+void ooo_retire(const RetireEvent *event);
+void ooo_close(void);
+
+#endif
@@ -1,7 +1,15 @@
+#include <stdarg.h> // for va_list
 #include <stdio.h> // for stderr
 #include <stdlib.h> // for exit()
 #include "types.h"
 #include "utils.h"
+#include "riscv.h"
+#include "csr.h"
+
+/* Output buffer of the instruction currently being formatted. It is per
+   thread so that disasm.c can format several chunks at once. */
+static __thread char *out_buf;
+static __thread size_t out_len, out_size;
 
 void print_rtype(char *, Instruction);
 void print_itype_except_load(char *, Instruction, int);
@@ -10,15 +18,33 @@ void print_store(char *, Instruction);
 void print_branch(char *, Instruction);
 void print_lui(Instruction);
 void print_jal(Instruction);
+void print_auipc(Instruction);
 void print_ecall(Instruction);
+void print_csr(char *, Instruction);
 void write_rtype(Instruction);
 void write_itype_except_load(Instruction); 
 void write_load(Instruction);
 void write_store(Instruction);
 void write_branch(Instruction);
+void write_system(Instruction);
+void write_invalid(Instruction);
+void emit(const char *, ...);
 
 
 void decode_instruction(uint32_t instruction_bits) {
+    char line[DISASM_LINE_MAX];
+    format_instruction(line, sizeof(line), instruction_bits);
+    fputs(line, stdout);
+}
+
+/* Formats the disassembly of one instruction (including the newline) into
+   buf and returns its length */
+size_t format_instruction(char *buf, size_t size, uint32_t instruction_bits) {
+    out_buf = buf;
+    out_len = 0;
+    out_size = size;
+    buf[0] = '\0';
+
     Instruction instruction = parse_instruction(instruction_bits);
     switch(instruction.opcode) {
         case 0x33:
@@ -39,33 +65,63 @@ void decode_instruction(uint32_t instruction_bits) {
         case 0x37:
             print_lui(instruction);
             break;
+        case 0x17:
+            print_auipc(instruction);
+            break;
         case 0x6F:
             print_jal(instruction);
             break;
+        case 0x67:
+            print_load("jalr", instruction);
+            break;
+        case 0x0F:
+            emit(instruction.itype.funct3 == 0x1 ? FENCE_I_FORMAT : FENCE_FORMAT);
+            break;
         case 0x73:
-            print_ecall(instruction);
+            write_system(instruction);
             break;
         default: // undefined opcode 
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
             break;
     }
+    return out_len;
+}
+
+void emit(const char *format, ...) {
+    va_list args;
+    int n;
+    va_start(args, format);
+    n = vsnprintf(out_buf + out_len, out_size - out_len, format, args);
+    va_end(args);
+    if (n > 0) {
+        out_len += (size_t)n < out_size - out_len ? (size_t)n : out_size - out_len - 1;
+    }
+}
+
+void write_invalid(Instruction instruction) {
+    emit("Invalid Instruction: 0x%08x\n", instruction.bits);
 }
 
 void write_rtype(Instruction instruction) {
+    // the M extension, selected by funct3
+    static char *const multiply_names[8] = {
+        "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+
+    if (instruction.rtype.funct7 == 0x1) {
+        print_rtype(multiply_names[instruction.rtype.funct3], instruction);
+        return;
+    }
     switch (instruction.rtype.funct3) {
         case 0x0:
             switch (instruction.rtype.funct7) {
                 case 0x0:
                     print_rtype("add", instruction);
                     break;
-                case 0x1:
-                    print_rtype("mul", instruction);
-                    break;
                 case 0x20:
                     print_rtype("sub", instruction);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    write_invalid(instruction);
                 break;      
             }
             break;
@@ -74,27 +130,24 @@ void write_rtype(Instruction instruction) {
                 case 0x0:
                 print_rtype("sll", instruction);
                 break;
-                case 0x1:
-                print_rtype("mulh", instruction);
-                break;
                 default:
-                handle_invalid_instruction(instruction);
+                write_invalid(instruction);
                 break;
             }
             break;
         case 0x2:
             print_rtype("slt", instruction);
             break;
+        case 0x3:
+            print_rtype("sltu", instruction);
+            break;
         case 0x4:
             switch (instruction.rtype.funct7) {
                 case 0x0:   
                 print_rtype("xor", instruction);
                 break;
-                case 0x1:
-                print_rtype("div", instruction);
-                break;
                 default:
-                handle_invalid_instruction(instruction);
+                write_invalid(instruction);
                 break;
             }
             break;
@@ -107,7 +160,7 @@ void write_rtype(Instruction instruction) {
                 print_rtype("sra", instruction);
                 break;
                 default:
-                handle_invalid_instruction(instruction);
+                write_invalid(instruction);
                 break;
             }
             break;
@@ -116,11 +169,8 @@ void write_rtype(Instruction instruction) {
                 case 0x0:
                 print_rtype("or", instruction);
                 break;
-                case 0x1:
-                print_rtype("rem", instruction);
-                break;
                 default:
-                handle_invalid_instruction(instruction);
+                write_invalid(instruction);
                 break;
             }
             break;
@@ -128,7 +178,7 @@ void write_rtype(Instruction instruction) {
             print_rtype("and", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
         break;
     }
 }
@@ -145,6 +195,9 @@ void write_itype_except_load(Instruction instruction) {
         case 0x2:
             print_itype_except_load("slti", instruction, instruction.itype.imm);
             break;
+        case 0x3:
+            print_itype_except_load("sltiu", instruction, instruction.itype.imm);
+            break;
         case 0x4:
             print_itype_except_load("xori", instruction, instruction.itype.imm);
             break;
@@ -158,7 +211,7 @@ void write_itype_except_load(Instruction instruction) {
                     print_itype_except_load("srai", instruction, instruction.itype.imm & 0x1F);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    write_invalid(instruction);
                     break;
             }
             break;
@@ -169,7 +222,7 @@ void write_itype_except_load(Instruction instruction) {
             print_itype_except_load("andi", instruction, instruction.itype.imm);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
             break;  
     }
 }
@@ -185,8 +238,14 @@ void write_load(Instruction instruction) {
         case 0x2:
             print_load("lw", instruction);
             break;
+        case 0x4:
+            print_load("lbu", instruction);
+            break;
+        case 0x5:
+            print_load("lhu", instruction);
+            break;
         default:
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
             break;
     }
 }
@@ -203,7 +262,7 @@ void write_store(Instruction instruction) {
             print_store("sw", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
             break;
     }
 }
@@ -216,35 +275,106 @@ void write_branch(Instruction instruction) {
         case 0x1:
             print_branch("bne", instruction);
             break;
+        case 0x4:
+            print_branch("blt", instruction);
+            break;
+        case 0x5:
+            print_branch("bge", instruction);
+            break;
+        case 0x6:
+            print_branch("bltu", instruction);
+            break;
+        case 0x7:
+            print_branch("bgeu", instruction);
+            break;
+        default:
+            write_invalid(instruction);
+            break;
+    }
+}
+
+void write_system(Instruction instruction) {
+    switch (instruction.itype.funct3) {
+        case 0x0:
+            print_ecall(instruction);
+            break;
+        case 0x1:
+            print_csr("csrrw", instruction);
+            break;
+        case 0x2:
+            print_csr("csrrs", instruction);
+            break;
+        case 0x3:
+            print_csr("csrrc", instruction);
+            break;
+        case 0x5:
+            print_csr("csrrwi", instruction);
+            break;
+        case 0x6:
+            print_csr("csrrsi", instruction);
+            break;
+        case 0x7:
+            print_csr("csrrci", instruction);
+            break;
         default:
-            handle_invalid_instruction(instruction);
+            write_invalid(instruction);
             break;
     }
 }
 
 void print_lui(Instruction instruction) {
     /* YOUR CODE HERE  U-TYPE*/ // LUI_FORMAT "lui\tx%d, %d\n"
-    printf(LUI_FORMAT,instruction.utype.rd, instruction.utype.imm);
+    emit(LUI_FORMAT,instruction.utype.rd, instruction.utype.imm);
 
 }
 
+void print_auipc(Instruction instruction) {
+    emit(AUIPC_FORMAT, instruction.utype.rd, instruction.utype.imm);
+}
+
 void print_jal(Instruction instruction) {
     /* YOUR CODE HERE UJ-TYPE*/ // JAL_FORMAT "jal\tx%d, %d\n"
-    printf(JAL_FORMAT,instruction.ujtype.rd, get_jump_offset(instruction));
+    emit(JAL_FORMAT,instruction.ujtype.rd, get_jump_offset(instruction));
 }
 
 void print_ecall(Instruction instruction) {
     /* YOUR CODE HERE I-TYPE*/ // ECALL_FORMAT "ecall\n"
-    printf(ECALL_FORMAT);
+    emit(ECALL_FORMAT);
+}
+
+void print_csr(char *name, Instruction instruction) {
+    const char *csr = csr_name(instruction.itype.imm);
+    char number[8];
+
+    /* csrrs rd, cycle, x0 and the like are the rdcycle pseudo-ops */
+    if (instruction.itype.funct3 == 0x2 && instruction.itype.rs1 == 0 &&
+        (instruction.itype.imm & 0xf7f) >= CSR_CYCLE &&
+        (instruction.itype.imm & 0xf7f) <= CSR_INSTRET) {
+        char pseudo[16];
+        snprintf(pseudo, sizeof(pseudo), "rd%s", csr);
+        emit(CSR_READ_FORMAT, pseudo, instruction.itype.rd);
+        return;
+    }
+    if (csr == NULL) {
+        snprintf(number, sizeof(number), "0x%03x", instruction.itype.imm);
+        csr = number;
+    }
+    if (instruction.itype.funct3 & 0x4) {
+        emit(CSRI_FORMAT, name, instruction.itype.rd, csr,
+             instruction.itype.rs1);
+    } else {
+        emit(CSR_FORMAT, name, instruction.itype.rd, csr,
+             instruction.itype.rs1);
+    }
 }
 
 void print_rtype(char *name, Instruction instruction) {
-  printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
+  emit(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
          instruction.rtype.rs2);
 }
 
 void print_itype_except_load(char *name, Instruction instruction, int imm) {
-    printf(ITYPE_FORMAT, name,
+    emit(ITYPE_FORMAT, name,
             instruction.itype.rd,
             instruction.itype.rs1,
             sign_extend_number(imm,12));
@@ -252,14 +382,14 @@ void print_itype_except_load(char *name, Instruction instruction, int imm) {
 }
 
 void print_load(char *name, Instruction instruction) {
-    printf(MEM_FORMAT, name,
+    emit(MEM_FORMAT, name,
             instruction.itype.rd,
-            instruction.itype.imm,
+            sign_extend_number(instruction.itype.imm, 12),
             instruction.itype.rs1);
 }
 
 void print_store(char *name, Instruction instruction) {
-    printf(MEM_FORMAT,name,
+    emit(MEM_FORMAT,name,
             instruction.stype.rs2,
              get_store_offset(instruction),
              instruction.stype.rs1);
@@ -268,5 +398,5 @@ void print_store(char *name, Instruction instruction) {
 void print_branch(char *name, Instruction instruction) {
     /* YOUR CODE HERE SB-TYPE*/
     //BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
-    printf(BRANCH_FORMAT,name, instruction.sbtype.rs1, instruction.sbtype.rs2, get_branch_offset(instruction));
+    emit(BRANCH_FORMAT,name, instruction.sbtype.rs1, instruction.sbtype.rs2, get_branch_offset(instruction));
 }
@@ -3,15 +3,27 @@
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "console.h"
+#include "csr.h"
+#include "cache.h"
+#include "bpred.h"
+#include "heatmap.h"
+#include "trace.h"
+#include "coverage.h"
 
 void execute_rtype(Instruction, Processor *);
+void execute_multiply(Instruction, Processor *);
 void execute_itype_except_load(Instruction, Processor *);
 void execute_branch(Instruction, Processor *);
 void execute_jal(Instruction, Processor *);
+void execute_jalr(Instruction, Processor *);
 void execute_load(Instruction, Processor *, Byte *);
 void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
+void execute_csr(Instruction, Processor *);
 void execute_lui(Instruction, Processor *);
+void execute_auipc(Instruction, Processor *);
+static Word read_memory(Byte *, Address, Alignment);
 
 void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *memory) {    
     Instruction instruction = parse_instruction(instruction_bits);
@@ -23,14 +35,21 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
             execute_itype_except_load(instruction, processor);
             break;
         case 0x73:
-            execute_ecall(processor, memory);
+            if (instruction.itype.funct3 == 0x0) {
+                execute_ecall(processor, memory);
+            } else {
+                execute_csr(instruction, processor);
+            }
             break;
         case 0x63:
             execute_branch(instruction, processor);
-            break;
+            return; // sets the PC itself
         case 0x6F:
             execute_jal(instruction, processor);
-            break;
+            return;
+        case 0x67:
+            execute_jalr(instruction, processor);
+            return;
         case 0x23:
             execute_store(instruction, processor, memory);
             break;
@@ -40,6 +59,12 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
         case 0x37:
             execute_lui(instruction, processor);
             break;
+        case 0x17:
+            execute_auipc(instruction, processor);
+            break;
+        case 0x0F:
+            // FENCE, FENCE.I: memory is always coherent here
+            break;
         default: // undefined opcode
             handle_invalid_instruction(instruction);
             exit(-1);
@@ -49,6 +74,10 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
 }
 
 void execute_rtype(Instruction instruction, Processor *processor) {
+    if (instruction.rtype.funct7 == 0x1) {
+        execute_multiply(instruction, processor);
+        return;
+    }
     switch (instruction.rtype.funct3){
         case 0x0:
             switch (instruction.rtype.funct7) {
@@ -58,12 +87,6 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                       ((sWord)processor->R[instruction.rtype.rs1]) +
                       ((sWord)processor->R[instruction.rtype.rs2]);
                   break;
-                case 0x1:
-                  // Mul
-                  processor->R[instruction.rtype.rd] =
-                      ((sWord)processor->R[instruction.rtype.rs1]) *
-                      ((sWord)processor->R[instruction.rtype.rs2]);
-                  break;
                 case 0x20:
                     // Sub
                     processor->R[instruction.rtype.rd] =
@@ -79,20 +102,14 @@ void execute_rtype(Instruction instruction, Processor *processor) {
         case 0x1:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                    // SLL @@@@@@@@@ no sWord
+                    // SLL
                     processor->R[instruction.rtype.rd] =
-                      (((sWord)processor->R[instruction.rtype.rs1]) <<
-                      (processor->R[instruction.rtype.rs2]));
-
+                      processor->R[instruction.rtype.rs1] <<
+                      (processor->R[instruction.rtype.rs2] & 0x1f);
                     break;
-                case 0x1:
-                    // MULH     rd = (rs1 * rs2)[63:32] return upper bits /////////////
-                    processor->R[instruction.rtype.rd] =
-                    ((sDouble)processor->R[instruction.rtype.rs1]) *
-                    ((sDouble)processor->R[instruction.rtype.rs2]);
-
-
-
+                default:
+                    handle_invalid_instruction(instruction);
+                    exit(-1);
                     break;
             }
             break;
@@ -104,10 +121,12 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             else{
                 processor->R[instruction.rtype.rd] = 0;
             }
-
-
-
-
+            break;
+        case 0x3:
+            // SLTU
+            processor->R[instruction.rtype.rd] =
+              processor->R[instruction.rtype.rs1] <
+              processor->R[instruction.rtype.rs2];
             break;
         case 0x4:
             switch (instruction.rtype.funct7) {
@@ -117,12 +136,6 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                       (((sWord)processor->R[instruction.rtype.rs1]) ^
                       ((sWord)processor->R[instruction.rtype.rs2]));
                     break;
-                case 0x1:
-                    // DIV
-                     processor->R[instruction.rtype.rd] =
-                      (((sWord)processor->R[instruction.rtype.rs1]) /
-                      ((sWord)processor->R[instruction.rtype.rs2]));
-                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
@@ -132,19 +145,16 @@ void execute_rtype(Instruction instruction, Processor *processor) {
         case 0x5:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                // SRL    /////////////
+                    // SRL
                     processor->R[instruction.rtype.rd] =
-                    (((sWord)processor->R[instruction.rtype.rs1]) >>
-                    processor->R[instruction.rtype.rs2]);   
+                    processor->R[instruction.rtype.rs1] >>
+                    (processor->R[instruction.rtype.rs2] & 0x1f);
                     break;
                 case 0x20:
-                    // SRA  /////////////
+                    // SRA
                     processor->R[instruction.rtype.rd] =
-                    (((sWord)processor->R[instruction.rtype.rs1]) >>
-                    processor->R[instruction.rtype.rs2]);  
-
-
-
+                    ((sWord)processor->R[instruction.rtype.rs1]) >>
+                    (processor->R[instruction.rtype.rs2] & 0x1f);
                     break;
                 default:
                     handle_invalid_instruction(instruction);
@@ -160,12 +170,6 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                       (((sWord)processor->R[instruction.rtype.rs1]) |
                       ((sWord)processor->R[instruction.rtype.rs2]));
                     break;
-                case 0x1:
-                    // REM
-                    processor->R[instruction.rtype.rd] =
-                      (((sWord)processor->R[instruction.rtype.rs1]) %
-                      ((sWord)processor->R[instruction.rtype.rs2]));
-                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
@@ -185,6 +189,56 @@ void execute_rtype(Instruction instruction, Processor *processor) {
     }
 }
 
+// The M extension. Each operation is a single 64-bit host multiply or a
+// 32-bit divide; division by zero and INT_MIN / -1 give the results the
+// spec defines instead of trapping the host.
+void execute_multiply(Instruction instruction, Processor *processor) {
+    Word a = processor->R[instruction.rtype.rs1];
+    Word b = processor->R[instruction.rtype.rs2];
+    int overflow = a == 0x80000000 && b == 0xffffffff;
+    Word result;
+
+    switch (instruction.rtype.funct3) {
+        case 0x0:
+            // MUL
+            result = a * b;
+            break;
+        case 0x1:
+            // MULH
+            result = (Word)(((sDouble)(sWord)a * (sDouble)(sWord)b) >> 32);
+            break;
+        case 0x2:
+            // MULHSU
+            result = (Word)(((sDouble)(sWord)a * (sDouble)b) >> 32);
+            break;
+        case 0x3:
+            // MULHU
+            result = (Word)(((Double)a * (Double)b) >> 32);
+            break;
+        case 0x4:
+            // DIV
+            result = b == 0 ? 0xffffffff
+                   : overflow ? a
+                   : (Word)((sWord)a / (sWord)b);
+            break;
+        case 0x5:
+            // DIVU
+            result = b == 0 ? 0xffffffff : a / b;
+            break;
+        case 0x6:
+            // REM
+            result = b == 0 ? a
+                   : overflow ? 0
+                   : (Word)((sWord)a % (sWord)b);
+            break;
+        default:
+            // REMU
+            result = b == 0 ? a : a % b;
+            break;
+    }
+    processor->R[instruction.rtype.rd] = result;
+}
+
 void execute_itype_except_load(Instruction instruction, Processor *processor) {
     switch (instruction.itype.funct3) {
         case 0x0:
@@ -195,8 +249,8 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             break;
         case 0x1:
             // SLLI
-            processor->R[instruction.itype.rd] = 
-            (sWord)processor->R[instruction.itype.rs1] << (sign_extend_number(instruction.itype.imm, 12) & 0x0000001f);
+            processor->R[instruction.itype.rd] =
+            processor->R[instruction.itype.rs1] << (instruction.itype.imm & 0x1f);
             break;
         case 0x2:
             // SLTI 983039  2701 -1395
@@ -210,6 +264,12 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
              //   instruction.itype.rd = 0;
             }
             break;
+        case 0x3:
+            // SLTIU: the immediate is sign-extended, then compared unsigned
+            processor->R[instruction.itype.rd] =
+            processor->R[instruction.itype.rs1] <
+            (Word)sign_extend_number(instruction.itype.imm, 12);
+            break;
         case 0x4:
             // XORI
             processor->R[instruction.itype.rd] =
@@ -219,8 +279,16 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             break;
         case 0x5:
             // Shift Right (You must handle both logical and arithmetic)
-            processor->R[instruction.itype.rd] = 
-            (sWord)processor->R[instruction.itype.rs1] >> (sign_extend_number(instruction.itype.imm, 12) & 0x0000001f);
+            if (instruction.itype.imm >> 10) {
+                // SRAI
+                processor->R[instruction.itype.rd] =
+                (sWord)processor->R[instruction.itype.rs1] >> (instruction.itype.imm & 0x1f);
+            } else {
+                // SRLI
+                processor->R[instruction.itype.rd] =
+                processor->R[instruction.itype.rs1] >> (instruction.itype.imm & 0x1f);
+            }
+            break;
 
         case 0x6:
             // ORI
@@ -231,7 +299,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
         case 0x7:
             // ANDI
             processor->R[instruction.itype.rd] = 
-            (sWord)processor->R[instruction.itype.rs1] & (sign_extend_number(instruction.itype.imm, 12) & 0x0000001f);
+            (sWord)processor->R[instruction.itype.rs1] & sign_extend_number(instruction.itype.imm, 12);
             break;
         default:
             handle_invalid_instruction(instruction);
@@ -240,25 +308,25 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
 }
 
 void execute_ecall(Processor *p, Byte *memory) {
-    Register i;
-    
     // syscall number is given by a0 (x10)
     // argument is given by a1
     switch(p->R[10]) {
         case 1: // print an integer
-            printf("%d",p->R[11]);
+            console_write_int(p->R[11]);
             break;
         case 4: // print a string
-            for(i=p->R[11];i<MEMORY_SPACE && load(memory,i,LENGTH_BYTE);i++) {
-                printf("%c",load(memory,i,LENGTH_BYTE));
-            }
+            console_write_string(memory, p->R[11]);
             break;
         case 10: // exit
             printf("exiting the simulator\n");
+            trace_exit();
             exit(0);
             break;
         case 11: // print a character
-            printf("%c",p->R[11]);
+            console_write_char(p->R[11]);
+            break;
+        case ECALL_FLUSH: // flush the console
+            console_flush();
             break;
         default: // undefined ecall
             printf("Illegal ecall number %d\n", p->R[10]);
@@ -267,40 +335,123 @@ void execute_ecall(Processor *p, Byte *memory) {
     }
 }
 
+void execute_csr(Instruction instruction, Processor *processor) {
+    unsigned int csr = instruction.itype.imm;
+    unsigned int rs1 = instruction.itype.rs1;
+    // the immediate forms use the rs1 field as a 5-bit unsigned value
+    Word operand = (instruction.itype.funct3 & 0x4) ? rs1 : processor->R[rs1];
+    Word old = 0, value;
+    int writes;
+
+    switch (instruction.itype.funct3 & 0x3) {
+        case 0x1:
+            // CSRRW, CSRRWI: only read the CSR if rd is not x0
+            writes = 1;
+            value = operand;
+            if (instruction.itype.rd != 0 && csr_read(csr, &old) != 0) {
+                handle_invalid_instruction(instruction);
+                exit(-1);
+            }
+            break;
+        case 0x2:
+        case 0x3:
+            // CSRRS(I), CSRRC(I): only write the CSR if rs1 is not x0
+            writes = rs1 != 0;
+            if (csr_read(csr, &old) != 0) {
+                handle_invalid_instruction(instruction);
+                exit(-1);
+            }
+            value = (instruction.itype.funct3 & 0x3) == 0x2 ? old | operand
+                                                            : old & ~operand;
+            break;
+        default:
+            handle_invalid_instruction(instruction);
+            exit(-1);
+            break;
+    }
+    if (writes && csr_write(csr, value) != 0) {
+        handle_invalid_instruction(instruction);
+        exit(-1);
+    }
+    processor->R[instruction.itype.rd] = old;
+}
+
 void execute_branch(Instruction instruction, Processor *processor) {
+    Address pc = processor->PC;
+    Address target = pc + get_branch_offset(instruction);
+    Word a = processor->R[instruction.sbtype.rs1];
+    Word b = processor->R[instruction.sbtype.rs2];
+    int taken;
+
     switch (instruction.sbtype.funct3) {
         case 0x0:
             // BEQ
+            taken = a == b;
             break;
         case 0x1:
             // BNE
+            taken = a != b;
+            break;
+        case 0x4:
+            // BLT
+            taken = (sWord)a < (sWord)b;
+            break;
+        case 0x5:
+            // BGE
+            taken = (sWord)a >= (sWord)b;
+            break;
+        case 0x6:
+            // BLTU
+            taken = a < b;
+            break;
+        case 0x7:
+            // BGEU
+            taken = a >= b;
             break;
         default:
             handle_invalid_instruction(instruction);
             exit(-1);
             break;
     }
+    if (bpred_enabled) {
+        bpred_branch(pc, target, taken);
+    }
+    processor->PC = taken ? target : pc + 4;
+    if (coverage_map) {
+        coverage_edge(processor->PC);
+    }
 }
 
 void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
     switch (instruction.itype.funct3) {
         case 0x0:
             // LB
-            processor->R[instruction.itype.rd] = 
-            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_BYTE);
+            processor->R[instruction.itype.rd] = sign_extend_number(
+            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_BYTE), 8);
             break;
         case 0x1:
             // LH
-            processor->R[instruction.itype.rd] = 
-            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_HALF_WORD);
+            processor->R[instruction.itype.rd] = sign_extend_number(
+            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_HALF_WORD), 16);
             break;
         case 0x2:
             // LW
             processor->R[instruction.itype.rd] = 
             load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_WORD);
             break;
+        case 0x4:
+            // LBU
+            processor->R[instruction.itype.rd] =
+            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_BYTE);
+            break;
+        case 0x5:
+            // LHU
+            processor->R[instruction.itype.rd] =
+            load(memory, (sWord)processor->R[instruction.itype.rs1] + (sWord)sign_extend_number(instruction.itype.imm,12),LENGTH_HALF_WORD);
+            break;
         default:
             handle_invalid_instruction(instruction);
+            exit(-1);
             break;
     }
 }
@@ -330,21 +481,53 @@ void execute_store(Instruction instruction, Processor *processor, Byte *memory)
 }
 
 void execute_jal(Instruction instruction, Processor *processor) {
-    /* YOUR CODE HERE */
-     printf("%x ",processor->R[instruction.ujtype.rd]);
-    processor->R[instruction.ujtype.rd] = (processor->PC + 4);
-    printf("%x \n",processor->R[instruction.ujtype.rd]);
-    printf("%x ",processor->PC);
-    processor->PC += get_jump_offset(instruction);
-    printf("%x \n",processor->PC);
+    Address pc = processor->PC;
+    Address target = pc + get_jump_offset(instruction);
+
+    if (bpred_enabled) {
+        bpred_jump(pc, target, instruction.ujtype.rd);
+    }
+    if (coverage_map) {
+        coverage_edge(target);
+    }
+    processor->R[instruction.ujtype.rd] = pc + 4;
+    processor->PC = target;
+}
+
+void execute_jalr(Instruction instruction, Processor *processor) {
+    Address pc = processor->PC;
+    // read rs1 before writing rd, which may be the same register
+    Address target = (processor->R[instruction.itype.rs1] +
+                      sign_extend_number(instruction.itype.imm, 12)) & ~1U;
+
+    if (bpred_enabled) {
+        bpred_indirect(pc, target, instruction.itype.rd,
+                       instruction.itype.rs1);
+    }
+    if (coverage_map) {
+        coverage_edge(target);
+    }
+    processor->R[instruction.itype.rd] = pc + 4;
+    processor->PC = target;
 }
 
 void execute_lui(Instruction instruction, Processor *processor) {
     processor->R[instruction.utype.rd] = ((sWord)sign_extend_number(instruction.utype.imm,21)<< 12 );
 }
 
+void execute_auipc(Instruction instruction, Processor *processor) {
+    processor->R[instruction.utype.rd] =
+    processor->PC + ((Word)instruction.utype.imm << 12);
+}
+
 void store(Byte *memory, Address address, Alignment alignment, Word value) {
     /* YOUR CODE HERE */
+    if (cache_enabled) {
+        cache_data(address, alignment, 1);
+    }
+    if (heatmap_enabled) {
+        heatmap_access(address, alignment, 1);
+    }
     if(alignment == LENGTH_WORD){
         Byte b = (Byte)((value & 0x000000ff));
         memory[address] = b;
@@ -367,7 +550,26 @@ void store(Byte *memory, Address address, Alignment alignment, Word value) {
     }
 }
 
+/* Fetches the instruction at address. Unlike load(), this goes through the
+   instruction cache model. */
+Word fetch(Byte *memory, Address address) {
+    if (cache_enabled) {
+        cache_fetch(address);
+    }
+    return read_memory(memory, address, LENGTH_WORD);
+}
+
 Word load(Byte *memory, Address address, Alignment alignment) {
+    if (cache_enabled) {
+        cache_data(address, alignment, 0);
+    }
+    if (heatmap_enabled) {
+        heatmap_access(address, alignment, 0);
+    }
+    return read_memory(memory, address, alignment);
+}
+
+static Word read_memory(Byte *memory, Address address, Alignment alignment) {
     /* YOUR CODE HERE */
     Word word = 0x00000000;
     if(alignment == LENGTH_WORD){
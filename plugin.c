@@ -0,0 +1,183 @@
+#include "plugin.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  RetireEvent events[PLUGIN_BATCH];
+  size_t count;
+} EventBatch;
+
+int plugin_mask;
+
+static const Plugin *builtin[PLUGIN_MAX]; /* registered at startup */
+static int builtin_count;
+static const Plugin *active[PLUGIN_MAX];  /* loaded with --plugin */
+static int active_count;
+
+static EventBatch retired, memory, branches, ecalls;
+static Address blocks[PLUGIN_BATCH];
+static size_t block_count;
+static int block_start = 1; /* the next instruction starts a block */
+
+void plugin_register(const Plugin *plugin) {
+  if (builtin_count < PLUGIN_MAX) {
+    builtin[builtin_count++] = plugin;
+  }
+}
+
+/* Loads NAME[:ARGS], a built in plugin or a shared object. Returns 0 on
+ * success. */
+int plugin_load(const char *spec) {
+  static int registered;
+  const Plugin *plugin = NULL;
+  const char *colon = strchr(spec, ':');
+  size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+  char *name;
+  void *handle;
+  int i;
+
+  if (active_count == PLUGIN_MAX) {
+    fprintf(stderr, "Too many plugins\n");
+    return -1;
+  }
+  name = strndup(spec, len);
+  if (name == NULL) {
+    fprintf(stderr, "Out of memory loading plugin %s\n", spec);
+    return -1;
+  }
+  for (i = 0; i < builtin_count && plugin == NULL; i++) {
+    if (strcmp(builtin[i]->name, name) == 0) {
+      plugin = builtin[i];
+    }
+  }
+  if (plugin == NULL) {
+    handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+      fprintf(stderr, "Cannot load plugin %s: %s\n", name, dlerror());
+      free(name);
+      return -1;
+    }
+    plugin = dlsym(handle, "riscv_plugin");
+    if (plugin == NULL) {
+      fprintf(stderr, "%s does not define riscv_plugin\n", name);
+      free(name);
+      return -1;
+    }
+  }
+  free(name);
+
+  if (plugin->init && plugin->init(colon ? colon + 1 : "") != 0) {
+    fprintf(stderr, "Plugin %s failed to start\n", plugin->name);
+    return -1;
+  }
+  active[active_count++] = plugin;
+  plugin_mask |= (plugin->retire ? PLUGIN_RETIRE : 0) |
+                 (plugin->memory ? PLUGIN_MEMORY : 0) |
+                 (plugin->branch ? PLUGIN_BRANCH : 0) |
+                 (plugin->ecall ? PLUGIN_ECALL : 0) |
+                 (plugin->block ? PLUGIN_BLOCK : 0);
+  if (!registered) {
+    atexit(plugin_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+/* Hands a batch to every plugin with a callback for its kind */
+static void flush_events(EventBatch *batch, int kind) {
+  void (*callback)(const RetireEvent *, size_t);
+  int i;
+
+  if (batch->count == 0) {
+    return;
+  }
+  for (i = 0; i < active_count; i++) {
+    callback = kind == PLUGIN_RETIRE   ? active[i]->retire
+               : kind == PLUGIN_MEMORY ? active[i]->memory
+               : kind == PLUGIN_BRANCH ? active[i]->branch
+                                       : active[i]->ecall;
+    if (callback) {
+      callback(batch->events, batch->count);
+    }
+  }
+  batch->count = 0;
+}
+
+static void flush_blocks(void) {
+  int i;
+
+  if (block_count == 0) {
+    return;
+  }
+  for (i = 0; i < active_count; i++) {
+    if (active[i]->block) {
+      active[i]->block(blocks, block_count);
+    }
+  }
+  block_count = 0;
+}
+
+/* Sorts a retired instruction into the batches plugins subscribed to */
+void plugin_retire(const RetireEvent *event) {
+  Word opcode = event->bits & 0x7f;
+  int control = opcode == 0x63 || opcode == 0x6f || opcode == 0x67;
+
+  if (plugin_mask & PLUGIN_RETIRE) {
+    retired.events[retired.count] = *event;
+    if (++retired.count == PLUGIN_BATCH) {
+      flush_events(&retired, PLUGIN_RETIRE);
+    }
+  }
+  if ((plugin_mask & PLUGIN_MEMORY) && event->mem_size) {
+    memory.events[memory.count] = *event;
+    if (++memory.count == PLUGIN_BATCH) {
+      flush_events(&memory, PLUGIN_MEMORY);
+    }
+  }
+  if ((plugin_mask & PLUGIN_BRANCH) && control) {
+    branches.events[branches.count] = *event;
+    if (++branches.count == PLUGIN_BATCH) {
+      flush_events(&branches, PLUGIN_BRANCH);
+    }
+  }
+  if ((plugin_mask & PLUGIN_ECALL) && opcode == 0x73 &&
+      (event->bits >> 12 & 0x7) == 0) {
+    ecalls.events[ecalls.count] = *event;
+    if (++ecalls.count == PLUGIN_BATCH) {
+      flush_events(&ecalls, PLUGIN_ECALL);
+    }
+  }
+  if (plugin_mask & PLUGIN_BLOCK) {
+    if (block_start) {
+      blocks[block_count] = event->pc;
+      if (++block_count == PLUGIN_BATCH) {
+        flush_blocks();
+      }
+    }
+    block_start = control || event->next_pc != event->pc + 4;
+  }
+}
+
+/* Hands over the last partial batches and stops the plugins. Called at
+ * exit. */
+void plugin_close(void) {
+  int i;
+
+  if (active_count == 0) {
+    return;
+  }
+  flush_events(&retired, PLUGIN_RETIRE);
+  flush_events(&memory, PLUGIN_MEMORY);
+  flush_events(&branches, PLUGIN_BRANCH);
+  flush_events(&ecalls, PLUGIN_ECALL);
+  flush_blocks();
+  for (i = 0; i < active_count; i++) {
+    if (active[i]->fini) {
+      active[i]->fini();
+    }
+  }
+  active_count = 0;
+  plugin_mask = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stddef.h>
+#include "event.h"
+#include "types.h"
+
+/* Instrumentation plugins (--plugin=NAME[:ARGS]). A plugin fills in a
+   Plugin with the callbacks it wants and leaves the others NULL:
+
+   retire  every retired instruction
+   memory  loads and stores
+   branch  branches and jumps, taken or not
+   ecall   environment calls (an exiting ecall never retires)
+   block   the pc of each basic block entered
+
+   Callbacks get events in batches of up to PLUGIN_BATCH; each callback
+   sees its own events in program order. A plugin is either built in,
+   by adding its source to PLUGIN_SOURCES in the Makefile and calling
+   PLUGIN_REGISTER, or loaded at run time from a shared object that
+   defines a Plugin named riscv_plugin. NAME is looked up among the built
+   in plugins first and otherwise opened as a shared object.
+
+   The simulator only builds events while plugin_mask is non-zero, so with
+   no plugin subscribed the run loop is unchanged. */
+#define PLUGIN_BATCH 1024
+#define PLUGIN_MAX 16
+
+typedef struct {
+  const char *name;
+  int (*init)(const char *args); /* returns 0 on success */
+  void (*retire)(const RetireEvent *events, size_t count);
+  void (*memory)(const RetireEvent *events, size_t count);
+  void (*branch)(const RetireEvent *events, size_t count);
+  void (*ecall)(const RetireEvent *events, size_t count);
+  void (*block)(const Address *starts, size_t count);
+  void (*fini)(void);
+} Plugin;
+
+enum {
+  PLUGIN_RETIRE = 1 << 0,
+  PLUGIN_MEMORY = 1 << 1,
+  PLUGIN_BRANCH = 1 << 2,
+  PLUGIN_ECALL = 1 << 3,
+  PLUGIN_BLOCK = 1 << 4
+};
+
+/* The kinds of event some plugin has subscribed to */
+extern int plugin_mask;
+
+void plugin_register(const Plugin *plugin);
+int plugin_load(const char *spec);
+void plugin_retire(const RetireEvent *event);
+void plugin_close(void);
+
+/* Registers a built in plugin before main() runs */
+#define PLUGIN_REGISTER(plugin)                                                \
+  static void __attribute__((constructor)) register_##plugin(void) {           \
+    plugin_register(&plugin);                                                  \
+  }
+
+#endif
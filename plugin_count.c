@@ -0,0 +1,48 @@
+#include "plugin.h"
+#include <stdio.h>
+
+/* The count plugin: prints how many events of each kind a run produced.
+ * It doubles as the smallest example of a built in plugin. */
+
+static Double retired, memory, branches, taken, ecalls, blocks;
+
+static void count_retire(const RetireEvent *events, size_t count) {
+  retired += count;
+}
+
+static void count_memory(const RetireEvent *events, size_t count) {
+  memory += count;
+}
+
+static void count_branch(const RetireEvent *events, size_t count) {
+  size_t i;
+
+  branches += count;
+  for (i = 0; i < count; i++) {
+    taken += events[i].next_pc != events[i].pc + 4;
+  }
+}
+
+static void count_ecall(const RetireEvent *events, size_t count) {
+  ecalls += count;
+}
+
+static void count_block(const Address *starts, size_t count) {
+  blocks += count;
+}
+
+static void count_fini(void) {
+  fprintf(stderr,
+          "count: %llu retired, %llu memory accesses, %llu branches and "
+          "jumps (%llu taken), %llu ecalls, %llu blocks\n",
+          (unsigned long long)retired, (unsigned long long)memory,
+          (unsigned long long)branches, (unsigned long long)taken,
+          (unsigned long long)ecalls, (unsigned long long)blocks);
+}
+
+static const Plugin count_plugin = {
+    "count",      NULL,        count_retire, count_memory,
+    count_branch, count_ecall, count_block,  count_fini,
+};
+
+PLUGIN_REGISTER(count_plugin)
@@ -0,0 +1,296 @@
+#include "profile.h"
+#include "callstack.h"
+#include "riscv.h"
+#include "symbols.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_SLOTS (MEMORY_SPACE / 4)
+
+typedef struct {
+  Address start;
+  Word length;       /* instructions */
+  Double executions; /* times the block was entered */
+  Double retired;    /* instructions retired in it */
+} Block;
+
+static char *profile_filename;
+static const Byte *profile_memory;
+static Double *profile_counts;  /* instructions retired at each pc */
+static Double *profile_entries; /* times each pc started a block */
+static int profile_block_start; /* the next instruction starts a block */
+static CallStack profile_stack;
+
+static int is_control(Word bits) {
+  Word opcode = bits & 0x7f;
+
+  return opcode == 0x63 || opcode == 0x6f || opcode == 0x67;
+}
+
+static Word profile_bits(Word slot) {
+  Word bits;
+
+  memcpy(&bits, profile_memory + 4 * slot, sizeof(bits));
+  return bits;
+}
+
+/* Starts profiling a program entered at entry. Returns 0 on success. */
+int profile_open(const char *filename, const Byte *memory, Address entry) {
+  static int registered;
+
+  profile_counts = calloc(PROFILE_SLOTS, sizeof(*profile_counts));
+  profile_entries = calloc(PROFILE_SLOTS, sizeof(*profile_entries));
+  profile_filename = strdup(filename);
+  if (profile_counts == NULL || profile_entries == NULL ||
+      profile_filename == NULL) {
+    fprintf(stderr, "Out of memory for profile\n");
+    return -1;
+  }
+  profile_memory = memory;
+  profile_block_start = 1;
+  callstack_init(&profile_stack, entry);
+  if (!registered) {
+    atexit(profile_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+/* Records an instruction that has just been executed */
+void profile_retire(Address pc, Word bits, Address next_pc) {
+  if (pc < MEMORY_SPACE) {
+    profile_counts[pc >> 2]++;
+    profile_entries[pc >> 2] += profile_block_start;
+  }
+  profile_block_start = next_pc != pc + 4 || is_control(bits);
+  callstack_retire(&profile_stack, pc, bits, next_pc);
+}
+
+static int compare_slots(const void *a, const void *b) {
+  Double x = profile_counts[*(const Word *)a];
+  Double y = profile_counts[*(const Word *)b];
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int compare_blocks(const void *a, const void *b) {
+  const Block *x = a, *y = b;
+
+  return x->retired < y->retired ? 1 : x->retired > y->retired ? -1 : 0;
+}
+
+static void print_instruction(FILE *out, Word slot) {
+  char line[DISASM_LINE_MAX];
+  Word bits = profile_bits(slot);
+
+  if (is_known_opcode(bits & 0x7f)) {
+    format_instruction(line, sizeof(line), bits);
+  } else {
+    strcpy(line, "(overwritten)\n");
+  }
+  fprintf(out, "%08x: %08x  %s", 4 * slot, bits, line);
+}
+
+/* Splits the executed code into basic blocks. A block starts where control
+ * arrived from elsewhere, after a branch or jump, or after code that never
+ * ran. */
+static Block *find_blocks(Word *count) {
+  Block *blocks = NULL, *block = NULL;
+  Word slot, size = 0;
+
+  *count = 0;
+  for (slot = 0; slot < PROFILE_SLOTS; slot++) {
+    if (profile_counts[slot] == 0) {
+      block = NULL;
+      continue;
+    }
+    if (block == NULL || profile_entries[slot] ||
+        is_control(profile_bits(slot - 1))) {
+      if (*count == size) {
+        size = size ? 2 * size : 256;
+        blocks = realloc(blocks, size * sizeof(*blocks));
+        if (blocks == NULL) {
+          fprintf(stderr, "Out of memory for profile\n");
+          exit(-1);
+        }
+      }
+      block = &blocks[(*count)++];
+      block->start = 4 * slot;
+      block->length = 0;
+      block->executions = profile_counts[slot];
+      block->retired = 0;
+    }
+    block->length++;
+    block->retired += profile_counts[slot];
+  }
+  return blocks;
+}
+
+static void write_report(FILE *out) {
+  Word *slots, count = 0, slot, i, j, nblocks;
+  Double total = 0, cumulative = 0;
+  Block *blocks;
+
+  slots = malloc(PROFILE_SLOTS * sizeof(*slots));
+  if (slots == NULL) {
+    fprintf(stderr, "Out of memory for profile\n");
+    exit(-1);
+  }
+  for (slot = 0; slot < PROFILE_SLOTS; slot++) {
+    if (profile_counts[slot]) {
+      slots[count++] = slot;
+      total += profile_counts[slot];
+    }
+  }
+  qsort(slots, count, sizeof(*slots), compare_slots);
+
+  fprintf(out, "%llu instructions retired at %u addresses\n\n",
+          (unsigned long long)total, count);
+  fprintf(out, "Hot spots\n");
+  fprintf(out, "%14s %7s %7s  instruction\n", "count", "%", "cum%");
+  for (i = 0; i < count && i < PROFILE_TOP_PCS; i++) {
+    cumulative += profile_counts[slots[i]];
+    fprintf(out, "%14llu %6.2f%% %6.2f%%  ",
+            (unsigned long long)profile_counts[slots[i]],
+            100.0 * profile_counts[slots[i]] / total,
+            100.0 * cumulative / total);
+    print_instruction(out, slots[i]);
+  }
+  free(slots);
+
+  blocks = find_blocks(&nblocks);
+  qsort(blocks, nblocks, sizeof(*blocks), compare_blocks);
+  fprintf(out, "\nHot basic blocks\n");
+  for (i = 0; i < nblocks && i < PROFILE_TOP_BLOCKS; i++) {
+    fprintf(out,
+            "\n%08x-%08x: entered %llu times, %llu instructions "
+            "(%.2f%%)\n",
+            blocks[i].start, blocks[i].start + 4 * (blocks[i].length - 1),
+            (unsigned long long)blocks[i].executions,
+            (unsigned long long)blocks[i].retired,
+            100.0 * blocks[i].retired / total);
+    for (j = 0; j < blocks[i].length && j < PROFILE_BLOCK_LINES; j++) {
+      slot = blocks[i].start / 4 + j;
+      fprintf(out, "%14llu  ", (unsigned long long)profile_counts[slot]);
+      print_instruction(out, slot);
+    }
+    if (blocks[i].length > PROFILE_BLOCK_LINES) {
+      fprintf(out, "%14s  ... %u more\n", "",
+              blocks[i].length - PROFILE_BLOCK_LINES);
+    }
+  }
+  free(blocks);
+}
+
+/* One line per calling context: the functions from the entry point down,
+ * separated by semicolons, and the instructions retired in it */
+static void write_folded(FILE *out) {
+  static Address frames[CALLSTACK_MAX_DEPTH + 1];
+  char name[PROFILE_NAME_MAX];
+  CallNode *node, *frame;
+  int depth;
+
+  for (node = &profile_stack.root; node; node = callstack_next(node)) {
+    if (node->self == 0) {
+      continue;
+    }
+    depth = 0;
+    for (frame = node; frame; frame = frame->parent) {
+      frames[depth++] = frame->function;
+    }
+    while (depth-- > 0) {
+      symbols_format(name, sizeof(name), frames[depth]);
+      fprintf(out, "%s%c", name, depth ? ';' : ' ');
+    }
+    fprintf(out, "%llu\n", (unsigned long long)node->self);
+  }
+}
+
+/* Writes key=(id) for function, followed by its name the first time */
+static void write_function(FILE *out, const char *key, Address function,
+                           Word *ids, Word *next_id) {
+  char name[PROFILE_NAME_MAX];
+  Word *id = function < MEMORY_SPACE ? &ids[function >> 2] : NULL;
+
+  symbols_format(name, sizeof(name), function);
+  if (id == NULL) {
+    fprintf(out, "%s=%s\n", key, name);
+  } else if (*id) {
+    fprintf(out, "%s=(%u)\n", key, *id);
+  } else {
+    *id = ++*next_id;
+    fprintf(out, "%s=(%u) %s\n", key, *id, name);
+  }
+}
+
+/* The calling context tree in callgrind format. Each context lists its own
+ * instructions at the function's entry address and the inclusive cost of
+ * each callee at the call site; viewers merge the contexts of a function. */
+static void write_callgrind(FILE *out) {
+  CallNode *node, *callee;
+  Word *ids, next_id = 0;
+
+  ids = calloc(PROFILE_SLOTS, sizeof(*ids));
+  if (ids == NULL) {
+    fprintf(stderr, "Out of memory for profile\n");
+    exit(-1);
+  }
+  callstack_totals(&profile_stack);
+  fprintf(out, "# callgrind format\nversion: 1\ncreator: riscv\n"
+               "positions: instr\nevents: Ir\nsummary: %llu\n",
+          (unsigned long long)profile_stack.root.total);
+  for (node = &profile_stack.root; node; node = callstack_next(node)) {
+    fprintf(out, "\n");
+    write_function(out, "fn", node->function, ids, &next_id);
+    fprintf(out, "0x%08x %llu\n", node->function,
+            (unsigned long long)node->self);
+    for (callee = node->child; callee; callee = callee->sibling) {
+      write_function(out, "cfn", callee->function, ids, &next_id);
+      fprintf(out, "calls=%llu 0x%08x\n0x%08x %llu\n",
+              (unsigned long long)callee->calls, callee->function,
+              callee->call_site, (unsigned long long)callee->total);
+    }
+  }
+  free(ids);
+}
+
+/* Writes profile_filename with suffix appended using write */
+static void write_file(const char *suffix, void (*write)(FILE *)) {
+  char *filename;
+  FILE *out;
+
+  filename = malloc(strlen(profile_filename) + strlen(suffix) + 1);
+  if (filename == NULL) {
+    fprintf(stderr, "Out of memory for profile\n");
+    return;
+  }
+  sprintf(filename, "%s%s", profile_filename, suffix);
+  out = fopen(filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create profile %s\n", filename);
+  } else {
+    write(out);
+    fclose(out);
+  }
+  free(filename);
+}
+
+/* Writes the report, the folded stacks and the call graph. Called at
+ * exit. */
+void profile_close(void) {
+  if (profile_counts == NULL) {
+    return;
+  }
+  write_file("", write_report);
+  write_file(".folded", write_folded);
+  write_file(".callgrind", write_callgrind);
+
+  callstack_free(&profile_stack);
+  free(profile_counts);
+  free(profile_entries);
+  free(profile_filename);
+  profile_counts = profile_entries = NULL;
+  profile_filename = NULL;
+}
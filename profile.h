@@ -0,0 +1,22 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+
+/* Instruction profiler (--profile=FILE). Counts retired instructions per
+   guest pc and per basic block, and follows calls with a CallStack. At exit
+   FILE gets a hot-spot report with annotated disassembly, FILE.folded the
+   folded stacks that flamegraph.pl and similar tools read, and
+   FILE.callgrind the call graph with exclusive and inclusive instruction
+   counts for KCachegrind and callgrind_annotate. Functions are named from
+   --symbols when it is given. */
+#define PROFILE_TOP_PCS 40
+#define PROFILE_TOP_BLOCKS 10
+#define PROFILE_BLOCK_LINES 64 /* longest block listing */
+#define PROFILE_NAME_MAX 128   /* longest function name written */
+
+int profile_open(const char *filename, const Byte *memory, Address entry);
+void profile_retire(Address pc, Word bits, Address next_pc);
+void profile_close(void);
+
+#endif
@@ -0,0 +1,73 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocates a ring of at least size bytes. Returns 0 on success. */
+int ring_init(Ring *ring, size_t size) {
+  size_t capacity = RING_CACHE_LINE;
+
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->buf = malloc(capacity);
+  if (ring->buf == NULL) {
+    return -1;
+  }
+  ring->mask = capacity - 1;
+  return 0;
+}
+
+void ring_destroy(Ring *ring) {
+  free(ring->buf);
+  ring->buf = NULL;
+}
+
+/* Producer side: appends len bytes, or returns 0 without writing anything
+ * if there is not enough room. */
+int ring_push(Ring *ring, const void *data, size_t len) {
+  size_t head = ring->head;
+  size_t offset = head & ring->mask;
+  size_t first;
+
+  if (head + len - ring->cached_tail > ring->mask + 1) {
+    ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head + len - ring->cached_tail > ring->mask + 1) {
+      return 0;
+    }
+  }
+
+  first = ring->mask + 1 - offset;
+  if (len <= first) {
+    memcpy(ring->buf + offset, data, len);
+  } else {
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, (const Byte *)data + first, len - first);
+  }
+  __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* Consumer side: points *data at the oldest unread bytes and returns how
+ * many of them are contiguous in the buffer. */
+size_t ring_peek(Ring *ring, const void **data) {
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  size_t tail = ring->tail;
+  size_t offset = tail & ring->mask;
+  size_t available = head - tail;
+
+  *data = ring->buf + offset;
+  if (available > ring->mask + 1 - offset) {
+    available = ring->mask + 1 - offset;
+  }
+  return available;
+}
+
+/* Consumer side: releases len bytes returned by ring_peek() */
+void ring_consume(Ring *ring, size_t len) {
+  __atomic_store_n(&ring->tail, ring->tail + len, __ATOMIC_RELEASE);
+}
+
+int ring_empty(Ring *ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
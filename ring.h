@@ -0,0 +1,30 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* A single-producer/single-consumer lock-free byte ring. The producer only
+   writes head and the consumer only writes tail, each on its own cache
+   line; the size is a power of two so positions wrap with a mask. */
+#define RING_CACHE_LINE 64
+
+typedef struct {
+  Byte *buf;
+  size_t mask;
+  char pad0[RING_CACHE_LINE];
+  size_t head;        /* next byte the producer writes */
+  size_t cached_tail; /* producer's last view of tail */
+  char pad1[RING_CACHE_LINE];
+  size_t tail;        /* next byte the consumer reads */
+  char pad2[RING_CACHE_LINE];
+} Ring;
+
+int ring_init(Ring *ring, size_t size);
+void ring_destroy(Ring *ring);
+int ring_push(Ring *ring, const void *data, size_t len);
+size_t ring_peek(Ring *ring, const void **data);
+void ring_consume(Ring *ring, size_t len);
+int ring_empty(Ring *ring);
+
+#endif
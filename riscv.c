@@ -1,4 +1,22 @@
 #include "riscv.h"
+#include "bench.h"
+#include "bpred.h"
+#include "cache.h"
+#include "console.h"
+#include "coverage.h"
+#include "decode.h"
+#include "event.h"
+#include "heatmap.h"
+#include "image.h"
+#include "lockstep.h"
+#include "ooo.h"
+#include "plugin.h"
+#include "profile.h"
+#include "stats.h"
+#include "symbols.h"
+#include "timing.h"
+#include "trace.h"
+#include "trigger.h"
 #include <assert.h>
 #include <getopt.h>
 #include <stdarg.h>
@@ -14,11 +32,99 @@
 
 // Pointer to simulator memory
 Byte *memory;
+// Predecoded instructions, filled in when running a .rvimg image
+DecodeCache decode_cache;
+// Instructions retired so far, the source of the cycle and instret CSRs
+Double retired;
+// Set by --profile
+static int profiling;
+// Counters of the only hart, set by --stats
+static StatsHart *stats;
+// Set by --timing
+static int timing;
+// Set by --ooo
+static int ooo_model;
 #define MAX_SIZE 50
 
+enum {
+  OPT_WRITE_IMAGE = 256,
+  OPT_TRACE_FILE,
+  OPT_TRACE_FORMAT,
+  OPT_TRACE_KEYFRAME,
+  OPT_TRACE_RING,
+  OPT_TRACE_DROP,
+  OPT_TRACE_COMPRESS,
+  OPT_LOCKSTEP,
+  OPT_TRACE_START_PC,
+  OPT_TRACE_STOP_PC,
+  OPT_TRACE_WINDOW,
+  OPT_TRACE_START_REG,
+  OPT_PROFILE,
+  OPT_SYMBOLS,
+  OPT_STATS,
+  OPT_CACHE,
+  OPT_CACHE_CONFIG,
+  OPT_BPRED,
+  OPT_BPRED_CONFIG,
+  OPT_TIMING,
+  OPT_TIMING_CONFIG,
+  OPT_OOO,
+  OPT_OOO_CONFIG,
+  OPT_PLUGIN,
+  OPT_HEATMAP,
+  OPT_HEATMAP_CONFIG,
+  OPT_COVERAGE,
+  OPT_BENCH,
+  OPT_BENCH_WARMUP,
+  OPT_BENCH_BUDGET,
+  OPT_BENCH_JSON,
+};
+
+static const struct option long_options[] = {
+    {"write-image", required_argument, NULL, OPT_WRITE_IMAGE},
+    {"trace-file", required_argument, NULL, OPT_TRACE_FILE},
+    {"trace-format", required_argument, NULL, OPT_TRACE_FORMAT},
+    {"trace-keyframe", required_argument, NULL, OPT_TRACE_KEYFRAME},
+    {"trace-ring", required_argument, NULL, OPT_TRACE_RING},
+    {"trace-drop", no_argument, NULL, OPT_TRACE_DROP},
+    {"trace-compress", no_argument, NULL, OPT_TRACE_COMPRESS},
+    {"lockstep", optional_argument, NULL, OPT_LOCKSTEP},
+    {"trace-start-pc", required_argument, NULL, OPT_TRACE_START_PC},
+    {"trace-stop-pc", required_argument, NULL, OPT_TRACE_STOP_PC},
+    {"trace-window", required_argument, NULL, OPT_TRACE_WINDOW},
+    {"trace-start-reg", required_argument, NULL, OPT_TRACE_START_REG},
+    {"profile", required_argument, NULL, OPT_PROFILE},
+    {"symbols", required_argument, NULL, OPT_SYMBOLS},
+    {"stats", required_argument, NULL, OPT_STATS},
+    {"cache", required_argument, NULL, OPT_CACHE},
+    {"cache-config", required_argument, NULL, OPT_CACHE_CONFIG},
+    {"bpred", required_argument, NULL, OPT_BPRED},
+    {"bpred-config", required_argument, NULL, OPT_BPRED_CONFIG},
+    {"timing", required_argument, NULL, OPT_TIMING},
+    {"timing-config", required_argument, NULL, OPT_TIMING_CONFIG},
+    {"ooo", required_argument, NULL, OPT_OOO},
+    {"ooo-config", required_argument, NULL, OPT_OOO_CONFIG},
+    {"plugin", required_argument, NULL, OPT_PLUGIN},
+    {"heatmap", required_argument, NULL, OPT_HEATMAP},
+    {"heatmap-config", required_argument, NULL, OPT_HEATMAP_CONFIG},
+    {"coverage", optional_argument, NULL, OPT_COVERAGE},
+    {"bench", optional_argument, NULL, OPT_BENCH},
+    {"bench-warmup", required_argument, NULL, OPT_BENCH_WARMUP},
+    {"bench-budget", required_argument, NULL, OPT_BENCH_BUDGET},
+    {"bench-json", required_argument, NULL, OPT_BENCH_JSON},
+    {NULL, 0, NULL, 0}};
+
 void execute(Processor *processor, int prompt, int print) {
+  RetireEvent event;
+  Address pc = processor->PC;
+  int observe = print || timing || ooo_model || plugin_mask;
+
   /* fetch an instruction */
-  uint32_t instruction_bits = load(memory, processor->PC, LENGTH_WORD);
+  uint32_t instruction_bits = fetch(memory, processor->PC);
+
+  if (observe) {
+    event_begin(&event, processor->PC, instruction_bits, processor);
+  }
 
   /* interactive-mode prompt */
   if (prompt) {
@@ -32,29 +138,71 @@ void execute(Processor *processor, int prompt, int print) {
     decode_instruction(instruction_bits);
   }
 
-  execute_instruction(instruction_bits, processor, memory);
+  const DecodedInstruction *decoded =
+      decode_cache_lookup(&decode_cache, processor->PC, instruction_bits);
+  if (decoded != NULL) {
+    execute_decoded(decoded, processor, memory);
+  } else {
+    execute_instruction(instruction_bits, processor, memory);
+  }
 
   // enforce $0 being hard-wired to 0
   processor->R[0] = 0;
 
+  if (profiling) {
+    profile_retire(pc, instruction_bits, processor->PC);
+  }
+  if (stats) {
+    stats_retire(stats, pc, instruction_bits, processor->PC);
+  }
+
+  if (observe) {
+    event_end(&event, processor);
+  }
+  if (timing) {
+    timing_retire(&event);
+  }
+  if (ooo_model) {
+    ooo_retire(&event);
+  }
+  if (plugin_mask) {
+    plugin_retire(&event);
+  }
+
   // print trace
   if (print) {
-    int i, j;
+    trace_retire(&event, processor);
+  }
+}
 
-    for (i = 0; i < 8; i++) {
-      for (j = 0; j < 4; j++) {
-        printf("r%2d=%08x ", i * 4 + j, processor->R[i * 4 + j]);
-      }
+/* Runs up to limit instructions, tracing only while a trigger window is
+ * open. Untraced stretches go through execute() with tracing off and only
+ * test the start conditions between instructions. */
+void execute_triggered(Processor *processor, int prompt, TraceTrigger *trigger,
+                       Double limit) {
+  int traced = trigger_starts_traced(trigger);
 
-      puts("");
+  while (retired < limit) {
+    if (traced) {
+      /* delta traces need the state the untraced stretch left behind */
+      trace_begin(processor);
+      do {
+        execute(processor, prompt, 1);
+        retired++;
+      } while (retired < limit && !trigger_stop(trigger, processor, retired));
+    } else {
+      trigger->reg_value = processor->R[trigger->start_reg];
+      while (retired < limit && !trigger_start(trigger, processor, retired)) {
+        execute(processor, prompt, 0);
+        retired++;
+      }
     }
-
-    printf("\n");
+    traced = !traced;
   }
 }
 
 int load_program(uint8_t *mem, size_t memsize, int startaddr,
-                 const char *filename, int disasm) {
+                 const char *filename) {
   FILE *file = fopen(filename, "r");
   char line[MAX_SIZE];
   int instruction, offset = 0;
@@ -67,27 +215,71 @@ int load_program(uint8_t *mem, size_t memsize, int startaddr,
     mem[startaddr + offset + 2] = (instruction >> 16) & 0xFF;
     mem[startaddr + offset + 3] = (instruction >> 24) & 0xFF;
 
-    if (disasm) {
-      printf("%08x: ", startaddr + offset);
-      decode_instruction((uint32_t)instruction);
-    }
-
     offset += 4;
   }
   return programsize;
 }
 
+/* Parses a size such as 4096, 64k or 16M */
+size_t parse_size(const char *arg) {
+  char *end;
+  size_t size = strtoull(arg, &end, 0);
+
+  switch (*end) {
+  case 'g':
+  case 'G':
+    size <<= 10;
+    /* fall through */
+  case 'm':
+  case 'M':
+    size <<= 10;
+    /* fall through */
+  case 'k':
+  case 'K':
+    size <<= 10;
+  }
+  return size;
+}
+
+/* Loads a precompiled .rvimg image; its decode table is used in place of
+ * decoding each instruction as it is executed. */
+int load_image(Image *image, uint8_t *mem, size_t memsize,
+               const char *filename) {
+  if (image_open(filename, image) != 0) {
+    exit(-1);
+  }
+  image_load(image, mem, memsize);
+  decode_cache = image->cache;
+  return image->header->numins;
+}
+
 int main(int argc, char **argv) {
   /* options */
   int opt_disasm = 0, opt_regdump = 0, opt_interactive = 0, opt_exit = 0,
       opt_init_reg = 0;
+  const char *opt_write_image = NULL, *opt_trace_file = NULL,
+             *opt_profile = NULL, *opt_symbols = NULL, *opt_stats = NULL,
+             *opt_cache = NULL, *opt_bpred = NULL, *opt_timing = NULL,
+             *opt_ooo = NULL, *opt_heatmap = NULL;
+  TraceFormat opt_trace_format = TRACE_BIN;
+  size_t opt_trace_ring = 0;
+  int opt_trace_drop = 0;
+  int opt_lockstep = 0;
+  Double opt_lockstep_interval = LOCKSTEP_DEFAULT_INTERVAL;
+  int opt_bench = 0;
+  int opt_coverage = 0;
+  const char *opt_coverage_file = NULL;
+  BenchConfig bench = {BENCH_DEFAULT_RUNS, BENCH_DEFAULT_WARMUP, 0, NULL};
+  TraceTrigger trigger;
+  Image image;
 
   /* the architectural state of the CPU */
   Processor processor;
 
   /* parse the command-line args */
   int c;
-  while ((c = getopt(argc, argv, "dvrite")) != -1) {
+  trigger_init(&trigger);
+  while ((c = getopt_long(argc, argv, "dvrite", long_options, NULL)) != -1) {
     switch (c) {
     case 'd':
       opt_disasm = 1;
@@ -107,6 +299,137 @@ int main(int argc, char **argv) {
     case 'e':
       opt_exit = 1;
       break;
+    case OPT_WRITE_IMAGE:
+      opt_write_image = optarg;
+      break;
+    case OPT_TRACE_FILE:
+      opt_trace_file = optarg;
+      opt_regdump = 1;
+      break;
+    case OPT_TRACE_KEYFRAME:
+      trace_set_keyframe_interval(strtoull(optarg, NULL, 0));
+      break;
+    case OPT_TRACE_RING:
+      opt_trace_ring = parse_size(optarg);
+      break;
+    case OPT_TRACE_DROP:
+      opt_trace_drop = 1;
+      break;
+    case OPT_TRACE_COMPRESS:
+      trace_set_compress(1);
+      break;
+    case OPT_TRACE_START_PC:
+      trigger.start_pc = strtoul(optarg, NULL, 0);
+      opt_regdump = 1;
+      break;
+    case OPT_TRACE_STOP_PC:
+      trigger.stop_pc = strtoul(optarg, NULL, 0);
+      opt_regdump = 1;
+      break;
+    case OPT_TRACE_WINDOW:
+      if (trigger_parse_window(&trigger, optarg) != 0) {
+        fprintf(stderr, "Bad trace window %s\n", optarg);
+        return -1;
+      }
+      opt_regdump = 1;
+      break;
+    case OPT_TRACE_START_REG:
+      if (trigger_parse_register(&trigger, optarg) != 0) {
+        fprintf(stderr, "Bad trace register %s\n", optarg);
+        return -1;
+      }
+      opt_regdump = 1;
+      break;
+    case OPT_PROFILE:
+      opt_profile = optarg;
+      break;
+    case OPT_SYMBOLS:
+      opt_symbols = optarg;
+      break;
+    case OPT_STATS:
+      opt_stats = optarg;
+      break;
+    case OPT_CACHE:
+      opt_cache = optarg;
+      break;
+    case OPT_CACHE_CONFIG:
+      if (cache_configure(optarg) != 0) {
+        fprintf(stderr, "Bad cache configuration %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPT_BPRED:
+      opt_bpred = optarg;
+      break;
+    case OPT_BPRED_CONFIG:
+      if (bpred_configure(optarg) != 0) {
+        fprintf(stderr, "Bad branch predictor configuration %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPT_TIMING:
+      opt_timing = optarg;
+      break;
+    case OPT_TIMING_CONFIG:
+      if (timing_configure(optarg) != 0) {
+        fprintf(stderr, "Bad timing configuration %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPT_OOO:
+      opt_ooo = optarg;
+      break;
+    case OPT_OOO_CONFIG:
+      if (ooo_configure(optarg) != 0) {
+        fprintf(stderr, "Bad out-of-order configuration %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPT_HEATMAP:
+      opt_heatmap = optarg;
+      break;
+    case OPT_HEATMAP_CONFIG:
+      if (heatmap_configure(optarg) != 0) {
+        fprintf(stderr, "Bad heatmap configuration %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPT_COVERAGE:
+      opt_coverage = 1;
+      opt_coverage_file = optarg;
+      break;
+    case OPT_PLUGIN:
+      if (plugin_load(optarg) != 0) {
+        return -1;
+      }
+      break;
+    case OPT_BENCH:
+      opt_bench = 1;
+      if (optarg) {
+        bench.runs = strtol(optarg, NULL, 0);
+      }
+      break;
+    case OPT_BENCH_WARMUP:
+      bench.warmup = strtol(optarg, NULL, 0);
+      break;
+    case OPT_BENCH_BUDGET:
+      bench.budget = strtoull(optarg, NULL, 0);
+      break;
+    case OPT_BENCH_JSON:
+      bench.json = optarg;
+      break;
+    case OPT_LOCKSTEP:
+      opt_lockstep = 1;
+      if (optarg) {
+        opt_lockstep_interval = strtoull(optarg, NULL, 0);
+      }
+      break;
+    case OPT_TRACE_FORMAT:
+      if (trace_parse_format(optarg, &opt_trace_format) != 0) {
+        fprintf(stderr, "Unknown trace format %s\n", optarg);
+        return -1;
+      }
+      break;
     default:
       fprintf(stderr, "Bad option %c\n", c);
       return -1;
@@ -119,6 +442,44 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  if (opt_lockstep && (opt_regdump || opt_interactive || opt_profile ||
+                       opt_stats || opt_cache || opt_bpred || opt_timing ||
+                       opt_ooo || opt_heatmap || opt_coverage ||
+                       plugin_mask)) {
+    fprintf(stderr, "--lockstep cannot be combined with -r, -i, --profile, "
+                    "--stats, --cache, --bpred, --timing, --ooo, --heatmap, "
+                    "--coverage or --plugin\n");
+    return -1;
+  }
+
+  if (bench.budget && !opt_bench) {
+    fprintf(stderr, "--bench-budget needs --bench\n");
+    return -1;
+  }
+
+  /* time plain runs of the program in child processes */
+  if (opt_bench) {
+    if (bench.runs < 1 || bench.warmup < 0) {
+      fprintf(stderr, "--bench needs at least one run\n");
+      return -1;
+    }
+    if (opt_regdump || opt_interactive || opt_lockstep || opt_disasm ||
+        opt_write_image) {
+      fprintf(stderr, "--bench cannot be combined with -r, -i, -d, "
+                      "--lockstep or --write-image\n");
+      return -1;
+    }
+    bench_run(&bench, argv[optind]);
+  }
+
+  /* under afl-fuzz this forks once per run, before the program is loaded */
+  if (opt_coverage && coverage_open(opt_coverage_file) != 0) {
+    return -1;
+  }
+
+  /* buffer guest output before anything is printed */
+  console_init();
+
   /* load the executable into memory */
   assert(memory == NULL);
   memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
@@ -126,11 +487,20 @@ int main(int argc, char **argv) {
   int prog_numins = 0;
   /* SEt the PC to 0x1000 */
   processor.PC = 0x1000;
-  prog_numins = load_program(memory, MEMORY_SPACE, processor.PC, argv[optind],
-                             opt_disasm);
+  if (image_is_image(argv[optind])) {
+    prog_numins = load_image(&image, memory, MEMORY_SPACE, argv[optind]);
+    processor.PC = image.header->base;
+  } else {
+    prog_numins =
+        load_program(memory, MEMORY_SPACE, processor.PC, argv[optind]);
+  }
+  /* precompile the program into an image and stop */
+  if (opt_write_image) {
+    return image_write(opt_write_image, memory, processor.PC, prog_numins);
+  }
   /* if we're just disassembling,exit here */
   if (opt_disasm) {
-    return 0;
+    return disassemble(memory, processor.PC, prog_numins) ? EXIT_FAILURE : 0;
   }
 
   /* initialize the CPU */
@@ -150,18 +520,95 @@ int main(int argc, char **argv) {
   /* Set the stack pointer near the top of the memory array */
   processor.R[2] = 0xEFFFF;
 
-  int simins = 0;
+  if (opt_symbols && symbols_load(opt_symbols, processor.PC) != 0) {
+    return -1;
+  }
+  if (opt_profile) {
+    if (profile_open(opt_profile, memory, processor.PC) != 0) {
+      return -1;
+    }
+    profiling = 1;
+  }
+  if (opt_stats) {
+    if (stats_open(opt_stats, 1) != 0) {
+      return -1;
+    }
+    stats = stats_hart(0);
+  }
+  if (opt_cache && cache_open(opt_cache, memory) != 0) {
+    return -1;
+  }
+  if (opt_heatmap && heatmap_open(opt_heatmap) != 0) {
+    return -1;
+  }
+  if (opt_bpred && bpred_open(opt_bpred, memory) != 0) {
+    return -1;
+  }
+  if (opt_timing) {
+    if (timing_open(opt_timing, memory) != 0) {
+      return -1;
+    }
+    timing = 1;
+  }
+  if (opt_ooo) {
+    if (ooo_open(opt_ooo) != 0) {
+      return -1;
+    }
+    ooo_model = 1;
+  }
+
+  /* -r dumps registers as text to stdout, --trace-file picks the format */
+  if (opt_regdump) {
+    if (opt_trace_ring || opt_trace_drop) {
+      trace_set_async(opt_trace_ring, opt_trace_drop);
+    }
+    if (trace_open(opt_trace_file,
+                   opt_trace_file ? opt_trace_format : TRACE_TEXT) != 0) {
+      return -1;
+    }
+    if (trigger_enabled(&trigger)) {
+      execute_triggered(&processor, opt_interactive, &trigger,
+                        opt_exit ? TRIGGER_NONE : (Double)prog_numins);
+      return 0;
+    }
+    trace_begin(&processor);
+  }
+
+  /* run the reference and predecoded engines side by side */
+  if (opt_lockstep) {
+    if (lockstep_init(&processor, memory, &decode_cache, processor.PC,
+                      prog_numins, opt_lockstep_interval) != 0) {
+      return -1;
+    }
+    while (opt_exit || retired < (Double)prog_numins) {
+      if (lockstep_step(&processor, memory) != 0) {
+        return EXIT_FAILURE;
+      }
+      retired++;
+    }
+    return lockstep_finish(&processor, memory) ? EXIT_FAILURE : 0;
+  }
 
-  if (opt_exit) {
+  if (opt_bench) {
+    bench_start();
+  }
+  if (bench.budget) {
+    /* run a fixed number of instructions, or until the program exits */
+    while (retired < bench.budget) {
+      execute(&processor, opt_interactive, opt_regdump);
+      retired++;
+    }
+  } else if (opt_exit) {
     /* simulate forever! */
     while (1) {
       execute(&processor, opt_interactive, opt_regdump);
+      retired++;
     }
   } else {
     /* Either simulate for program instructions */
-    while (simins < prog_numins) {
+    while (retired < (Double)prog_numins) {
       execute(&processor, opt_interactive, opt_regdump);
-      simins++;
+      retired++;
     }
   }
   return 0;
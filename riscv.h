@@ -1,14 +1,26 @@
 #ifndef MIPS_H
 #define MIPS_H
 
+#include <stddef.h>
 #include "types.h"
 
+/* Longest line format_instruction() produces, including the newline */
+#define DISASM_LINE_MAX 64
+
 /* see part1.c */
 void decode_instruction(uint32_t instruction_bits);
+size_t format_instruction(char *buf, size_t size, uint32_t instruction_bits);
 
 /* see part2.c */
 void execute_instruction(uint32_t instruction_bits, Processor* processor, Byte *memory);
 void store(Byte *memory, Address address, Alignment alignment, Word value);
 Word load(Byte *memory, Address address, Alignment alignment);
+Word fetch(Byte *memory, Address address);
+
+/* see riscv.c */
+extern Double retired; /* instructions retired so far */
+
+/* see disasm.c */
+int disassemble(const Byte *memory, Address base, Word count);
 
 #endif
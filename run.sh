@@ -11,7 +11,7 @@ function run_cmd_with_check() {
   fi
 }
 
-run_cmd_with_check make riscv
+run_cmd_with_check make riscv rvcmp
 run_cmd_with_check python3 driver.py -D ./code/out
 cat LOG.md >> LOG
 
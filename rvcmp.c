@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include "traceread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* rvcmp - compares a register trace against a reference trace and reports
+ * where they first diverge.
+ *
+ *   rvcmp [-d] [-m MAX] [-C CONTEXT] REF TRACE
+ *
+ * Either trace may be a -r text dump or any --trace-file format. Identical
+ * prefixes of two uncompressed traces of the same format are skipped with
+ * memcmp before any record is parsed.
+ *
+ * -d  accept a register whose change matches the reference's change even
+ *     if the values differ (the rule part2_tester.py uses)
+ * -m  stop after MAX mismatching registers, 0 reports them all (default 1)
+ * -C  instructions of context printed before the first mismatch (default 3)
+ */
+
+#define MAX_CONTEXT 64
+#define SCAN_BLOCK (1 << 16)
+
+typedef struct {
+  Register R[32];
+  Address pc;
+} State;
+
+static int opt_delta;
+static Double opt_max = 1;
+static int opt_context = 3;
+
+/* The last opt_context + 2 states of each trace, for context */
+static State history[2][MAX_CONTEXT + 2];
+static Double history_count;
+static int history_pc[2]; /* whether each trace records the pc */
+
+static State *history_state(int side, Double index) {
+  return &history[side][index % (opt_context + 2)];
+}
+
+/* Length of the common prefix of a and b */
+static size_t common_prefix(const Byte *a, const Byte *b, size_t len) {
+  size_t pos = 0, block;
+
+  while (pos < len) {
+    block = len - pos < SCAN_BLOCK ? len - pos : SCAN_BLOCK;
+    if (memcmp(a + pos, b + pos, block) != 0) {
+      break;
+    }
+    pos += block;
+  }
+  while (pos < len && a[pos] == b[pos]) {
+    pos++;
+  }
+  return pos;
+}
+
+/* Start of the text dump before the one starting at or containing pos.
+ * Dumps end with a blank line. */
+static size_t text_dump_start(const Byte *data, size_t pos) {
+  while (pos >= 2 && !(data[pos - 1] == '\n' && data[pos - 2] == '\n')) {
+    pos--;
+  }
+  return pos < 2 ? 0 : pos;
+}
+
+static Double text_dump_count(const Byte *data, size_t len) {
+  const Byte *p = data, *end = data + len;
+  Double count = 0;
+
+  while ((p = memchr(p, '\n', end - p)) != NULL && ++p < end) {
+    if (*p == '\n') {
+      count++;
+      p++;
+    }
+  }
+  return count;
+}
+
+/* Skips the identical leading part of two uncompressed traces of the same
+ * format, stopping opt_context + 1 instructions short of the first
+ * difference so that the comparison loop has its previous values and
+ * context. */
+static void skip_common_prefix(TraceReader *ref, TraceReader *trace) {
+  size_t start = ref->pos, len, pos;
+  const Byte *invalid;
+  Double index;
+  int back;
+
+  if (ref->header.format != trace->header.format ||
+      (ref->header.flags & TRACE_COMPRESSED) ||
+      (trace->header.flags & TRACE_COMPRESSED) ||
+      ref->header.format == TRACE_DELTA) {
+    return;
+  }
+  len = ref->end < trace->end ? ref->end : trace->end;
+  pos = common_prefix(ref->data, trace->data, len);
+
+  if (ref->header.format == TRACE_BIN) {
+    index = pos > start ? (pos - start) / sizeof(TraceRetire) : 0;
+    index = index > (Double)opt_context + 1 ? index - opt_context - 1 : 0;
+    trace_reader_jump(ref, start + index * sizeof(TraceRetire), index);
+    trace_reader_jump(trace, start + index * sizeof(TraceRetire), index);
+    return;
+  }
+
+  /* invalid instructions must still be reported */
+  invalid = memmem(trace->data, pos, "Invalid", 7);
+  if (invalid != NULL) {
+    pos = invalid - trace->data;
+  }
+  pos = text_dump_start(ref->data, pos);
+  for (back = 0; back < opt_context + 1 && pos > 0; back++) {
+    pos = text_dump_start(ref->data, pos - 1);
+  }
+  index = text_dump_count(ref->data, pos);
+  trace_reader_jump(ref, pos, index);
+  trace_reader_jump(trace, pos, index);
+}
+
+static void print_written(const State *state, const State *prev) {
+  int i, n = 0;
+
+  for (i = 0; i < 32; i++) {
+    if (prev == NULL || state->R[i] != prev->R[i]) {
+      printf(" r%2d=%08x", i, state->R[i]);
+      n++;
+    }
+  }
+  if (n == 0) {
+    printf(" -");
+  }
+}
+
+/* Prints the registers each of the last few instructions wrote */
+static void print_context(Double index) {
+  static const State zero;
+  Double stored = history_count < (Double)opt_context + 2 ? history_count
+                                                          : opt_context + 2;
+  Double oldest = index + 1 - stored, first = oldest, i;
+  const State *state, *prev;
+  int side;
+
+  if (index - first > (Double)opt_context) {
+    first = index - opt_context;
+  }
+  printf("context (registers written by each instruction):\n");
+  for (i = first; i <= index; i++) {
+    for (side = 0; side < 2; side++) {
+      state = history_state(side, i);
+      prev = i > oldest ? history_state(side, i - 1) : i == 0 ? &zero : NULL;
+      printf("%c %10llu %s ", i == index && side == 0 ? '>' : ' ',
+             (unsigned long long)i, side == 0 ? "ref  " : "trace");
+      if (history_pc[side]) {
+        printf("pc %08x:", state->pc);
+      } else {
+        printf("pc --------:");
+      }
+      print_written(state, prev);
+      printf("\n");
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  TraceReader ref, trace;
+  Double mismatches = 0, index;
+  int c, i, rs, ts, status = 0;
+  State *r, *t, *rprev, *tprev;
+
+  while ((c = getopt(argc, argv, "dm:C:")) != -1) {
+    switch (c) {
+    case 'd':
+      opt_delta = 1;
+      break;
+    case 'm':
+      opt_max = strtoull(optarg, NULL, 0);
+      break;
+    case 'C':
+      opt_context = atoi(optarg);
+      if (opt_context < 0 || opt_context > MAX_CONTEXT) {
+        fprintf(stderr, "Context must be between 0 and %d\n", MAX_CONTEXT);
+        return -1;
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d] [-m MAX] [-C CONTEXT] REF TRACE\n",
+              argv[0]);
+      return -1;
+    }
+  }
+  if (argc != optind + 2) {
+    fprintf(stderr, "usage: %s [-d] [-m MAX] [-C CONTEXT] REF TRACE\n",
+            argv[0]);
+    return -1;
+  }
+  if (trace_reader_open(&ref, argv[optind]) != 0) {
+    return -1;
+  }
+  if (trace_reader_open(&trace, argv[optind + 1]) != 0) {
+    trace_reader_close(&ref);
+    return -1;
+  }
+
+  history_pc[0] = ref.header.format != TRACE_TEXT;
+  history_pc[1] = trace.header.format != TRACE_TEXT;
+  skip_common_prefix(&ref, &trace);
+  history_count = 0;
+  for (;;) {
+    rs = trace_reader_next(&ref);
+    ts = trace_reader_next(&trace);
+    index = ref.index - 1;
+    if (rs < 0 || ts < 0) {
+      status = 1;
+      break;
+    }
+    if (rs == 0 && ts == 0) {
+      break;
+    }
+    if (rs == 0 || ts == 0) {
+      printf("ERROR: %s trace finished before %s trace\n",
+             rs == 0 ? "reference" : "compared",
+             rs == 0 ? "compared" : "reference");
+      status = 1;
+      break;
+    }
+
+    r = history_state(0, index);
+    t = history_state(1, index);
+    rprev = history_state(0, index - 1);
+    tprev = history_state(1, index - 1);
+    memcpy(r->R, ref.R, sizeof(r->R));
+    memcpy(t->R, trace.R, sizeof(t->R));
+    r->pc = ref.pc;
+    t->pc = trace.pc;
+    if (history_count == 0) {
+      /* the previous values are zero, as in part2_tester.py */
+      memset(rprev, 0, sizeof(*rprev));
+      memset(tprev, 0, sizeof(*tprev));
+    }
+    history_count++;
+    if (memcmp(r->R, t->R, sizeof(r->R)) == 0) {
+      continue;
+    }
+
+    for (i = 0; i < 32; i++) {
+      if (r->R[i] == t->R[i] ||
+          (opt_delta && r->R[i] - rprev->R[i] == t->R[i] - tprev->R[i])) {
+        continue;
+      }
+      printf("ERROR: instruction %llu, register %d. Expected: 0x%08x, "
+             "Actual: 0x%08x\n",
+             (unsigned long long)index, i, r->R[i], t->R[i]);
+      if (mismatches++ == 0) {
+        print_context(index);
+      }
+      status = 1;
+      if (opt_max && mismatches >= opt_max) {
+        break;
+      }
+    }
+    if (opt_max && mismatches >= opt_max) {
+      break;
+    }
+  }
+
+  if (ref.skipped || trace.skipped) {
+    printf("ERROR: %s trace is missing instructions\n",
+           ref.skipped ? "reference" : "compared");
+    status = 1;
+  }
+  if (status == 0) {
+    printf("traces match\n");
+  }
+  trace_reader_close(&ref);
+  trace_reader_close(&trace);
+  return status;
+}
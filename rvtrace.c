@@ -0,0 +1,90 @@
+#include "trace.h"
+#include "traceread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* rvtrace - prints a binary or delta trace written with --trace-file in the
+ * exact text format of -r, so that part2_tester.py and the reference traces
+ * in code/ref keep working. A program that ended with the exit ecall ends
+ * with "exiting the simulator", as under -r; anything else the program
+ * printed to the console is not in the trace.
+ *
+ *   rvtrace [-s FIRST] [-n COUNT] TRACE
+ *
+ * -s and -n select a window of instructions. Delta traces seek to the
+ * nearest keyframe before FIRST using the index at the end of the file,
+ * compressed traces to the chunk holding FIRST. */
+
+#define OUTPUT_SIZE (1 << 20)
+
+static char output[OUTPUT_SIZE];
+static size_t output_len;
+
+static void flush_output(void) {
+  if (fwrite(output, 1, output_len, stdout) != output_len) {
+    fprintf(stderr, "Error writing output\n");
+    exit(-1);
+  }
+  output_len = 0;
+}
+
+static void print_registers(const Register *R) {
+  if (output_len + TRACE_TEXT_SIZE > OUTPUT_SIZE) {
+    flush_output();
+  }
+  output_len += trace_format_text(output + output_len, R);
+}
+
+int main(int argc, char **argv) {
+  Double first = 0, count = (Double)-1, printed;
+  TraceReader reader;
+  int c, status, ended = 0;
+
+  while ((c = getopt(argc, argv, "s:n:")) != -1) {
+    switch (c) {
+    case 's':
+      first = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      count = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s FIRST] [-n COUNT] TRACE\n", argv[0]);
+      return -1;
+    }
+  }
+  if (argc != optind + 1) {
+    fprintf(stderr, "usage: %s [-s FIRST] [-n COUNT] TRACE\n", argv[0]);
+    return -1;
+  }
+
+  if (trace_reader_open(&reader, argv[optind]) != 0) {
+    return -1;
+  }
+  if (reader.header.format == TRACE_TEXT) {
+    fprintf(stderr, "%s is not a binary trace\n", argv[optind]);
+    trace_reader_close(&reader);
+    return -1;
+  }
+
+  status = trace_reader_seek(&reader, first);
+  for (printed = 0; status == 0 && printed < count; printed++) {
+    status = trace_reader_next(&reader);
+    if (status <= 0) {
+      ended = status == 0;
+      break;
+    }
+    print_registers(reader.R);
+    status = 0;
+  }
+  if (ended && (reader.header.flags & TRACE_EXITED)) {
+    output_len += sprintf(output + output_len, "exiting the simulator\n");
+  }
+  flush_output();
+  if (status >= 0 && reader.skipped) {
+    status = 1; /* printed, but with gaps where records were dropped */
+  }
+  trace_reader_close(&reader);
+  return status < 0 ? -1 : status;
+}
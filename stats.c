@@ -0,0 +1,187 @@
+#include "stats.h"
+#include "riscv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_SLOTS (MEMORY_SPACE / 4)
+
+static const char *const class_names[STATS_CLASS_COUNT] = {
+    "alu", "load", "store", "branch_taken", "branch_not_taken",
+    "jump", "ecall", "csr", "other",
+};
+
+/* What the instruction last executed at each pc decoded to */
+typedef struct {
+  Word bits;
+  Byte mnemonic;
+  Byte class; /* a StatsClass, branches as STATS_BRANCH_TAKEN */
+  Byte valid;
+} StatsSlot;
+
+static char *stats_filename;
+static StatsSlot *stats_slots;
+static StatsHart *stats_harts;
+static int stats_hart_count;
+static char mnemonics[STATS_MAX_MNEMONICS][STATS_MNEMONIC_SIZE];
+static int mnemonic_count;
+
+/* Starts counting for the given number of harts. Returns 0 on success. */
+int stats_open(const char *filename, int harts) {
+  static int registered;
+
+  stats_filename = strdup(filename);
+  stats_slots = calloc(STATS_SLOTS, sizeof(*stats_slots));
+  stats_harts = calloc(harts, sizeof(*stats_harts));
+  if (stats_filename == NULL || stats_slots == NULL || stats_harts == NULL) {
+    fprintf(stderr, "Out of memory for statistics\n");
+    return -1;
+  }
+  stats_hart_count = harts;
+  if (!registered) {
+    atexit(stats_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+StatsHart *stats_hart(int hart) { return &stats_harts[hart]; }
+
+static StatsClass classify(Word bits) {
+  switch (bits & 0x7f) {
+  case 0x33:
+  case 0x13:
+  case 0x37:
+  case 0x17:
+    return STATS_ALU;
+  case 0x03:
+    return STATS_LOAD;
+  case 0x23:
+    return STATS_STORE;
+  case 0x63:
+    return STATS_BRANCH_TAKEN;
+  case 0x6f:
+  case 0x67:
+    return STATS_JUMP;
+  case 0x73:
+    return (bits >> 12 & 0x7) == 0 ? STATS_ECALL : STATS_CSR;
+  default:
+    return STATS_OTHER;
+  }
+}
+
+/* Returns the index of the mnemonic part1.c prints for bits */
+static Byte intern_mnemonic(Word bits) {
+  char line[DISASM_LINE_MAX];
+  size_t len;
+  int i;
+
+  format_instruction(line, sizeof(line), bits);
+  len = strcspn(line, "\t\n");
+  if (len >= STATS_MNEMONIC_SIZE) {
+    len = STATS_MNEMONIC_SIZE - 1;
+  }
+  line[len] = '\0';
+  for (i = 0; i < mnemonic_count; i++) {
+    if (strcmp(mnemonics[i], line) == 0) {
+      return i;
+    }
+  }
+  if (mnemonic_count == STATS_MAX_MNEMONICS) {
+    fprintf(stderr, "Too many mnemonics for statistics\n");
+    exit(-1);
+  }
+  strcpy(mnemonics[mnemonic_count], line);
+  return mnemonic_count++;
+}
+
+/* Records an instruction that has just been executed. Decoding is cached
+ * per pc, so only the first execution of each instruction formats it. */
+void stats_retire(StatsHart *hart, Address pc, Word bits, Address next_pc) {
+  StatsSlot local, *slot = &local;
+  StatsClass class;
+
+  if (pc < MEMORY_SPACE && !(pc & 3)) {
+    slot = &stats_slots[pc >> 2];
+  }
+  if (!slot->valid || slot->bits != bits) {
+    slot->bits = bits;
+    slot->mnemonic = intern_mnemonic(bits);
+    slot->class = classify(bits);
+    slot->valid = 1;
+  }
+  class = slot->class;
+  if (class == STATS_BRANCH_TAKEN && next_pc == pc + 4) {
+    class = STATS_BRANCH_NOT_TAKEN;
+  }
+  hart->mnemonic[slot->mnemonic]++;
+  hart->class[class]++;
+}
+
+/* Counts the mnemonics are sorted by */
+static const Double *sort_counts;
+
+static int compare_mnemonics(const void *a, const void *b) {
+  Double x = sort_counts[*(const int *)a], y = sort_counts[*(const int *)b];
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* Merges the harts and writes the JSON report. Called at exit. */
+void stats_close(void) {
+  StatsHart total;
+  int order[STATS_MAX_MNEMONICS];
+  Double instructions = 0;
+  FILE *out;
+  int i, h;
+
+  if (stats_harts == NULL) {
+    return;
+  }
+  memset(&total, 0, sizeof(total));
+  for (h = 0; h < stats_hart_count; h++) {
+    for (i = 0; i < mnemonic_count; i++) {
+      total.mnemonic[i] += stats_harts[h].mnemonic[i];
+    }
+    for (i = 0; i < STATS_CLASS_COUNT; i++) {
+      total.class[i] += stats_harts[h].class[i];
+    }
+  }
+  for (i = 0; i < STATS_CLASS_COUNT; i++) {
+    instructions += total.class[i];
+  }
+  for (i = 0; i < mnemonic_count; i++) {
+    order[i] = i;
+  }
+  sort_counts = total.mnemonic;
+  qsort(order, mnemonic_count, sizeof(*order), compare_mnemonics);
+
+  out = fopen(stats_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create statistics file %s\n", stats_filename);
+  } else {
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"harts\": %d,\n",
+            (unsigned long long)instructions, stats_hart_count);
+    fprintf(out, "  \"classes\": {\n");
+    for (i = 0; i < STATS_CLASS_COUNT; i++) {
+      fprintf(out, "    \"%s\": %llu%s\n", class_names[i],
+              (unsigned long long)total.class[i],
+              i + 1 < STATS_CLASS_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n  \"mnemonics\": {\n");
+    for (i = 0; i < mnemonic_count; i++) {
+      fprintf(out, "    \"%s\": %llu%s\n", mnemonics[order[i]],
+              (unsigned long long)total.mnemonic[order[i]],
+              i + 1 < mnemonic_count ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+    fclose(out);
+  }
+
+  free(stats_slots);
+  free(stats_harts);
+  free(stats_filename);
+  stats_slots = NULL;
+  stats_harts = NULL;
+  stats_filename = NULL;
+}
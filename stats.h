@@ -0,0 +1,36 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"
+
+/* Dynamic instruction mix (--stats=FILE). Retired instructions are counted
+   by mnemonic, named exactly as part1.c prints them, and by class. Every
+   hart counts into its own StatsHart; the harts are merged when the JSON
+   report is written at exit. */
+#define STATS_MAX_MNEMONICS 128
+#define STATS_MNEMONIC_SIZE 16
+
+typedef enum {
+  STATS_ALU,
+  STATS_LOAD,
+  STATS_STORE,
+  STATS_BRANCH_TAKEN,
+  STATS_BRANCH_NOT_TAKEN,
+  STATS_JUMP,
+  STATS_ECALL,
+  STATS_CSR,
+  STATS_OTHER,
+  STATS_CLASS_COUNT
+} StatsClass;
+
+typedef struct {
+  Double mnemonic[STATS_MAX_MNEMONICS];
+  Double class[STATS_CLASS_COUNT];
+} StatsHart;
+
+int stats_open(const char *filename, int harts);
+StatsHart *stats_hart(int hart);
+void stats_retire(StatsHart *hart, Address pc, Word bits, Address next_pc);
+void stats_close(void);
+
+#endif
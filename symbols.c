@@ -0,0 +1,171 @@
+#include "symbols.h"
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  Address address;
+  char *name;
+} Symbol;
+
+static Symbol *symbols;
+static size_t symbol_count;
+
+static int compare_symbols(const void *a, const void *b) {
+  const Symbol *x = a, *y = b;
+
+  return x->address < y->address ? -1 : x->address > y->address ? 1 : 0;
+}
+
+/* Reads a whole file. Returns NULL on failure. */
+static unsigned char *read_file(const char *filename, size_t *size) {
+  unsigned char *data = NULL;
+  FILE *file = fopen(filename, "rb");
+  long length;
+
+  if (file == NULL) {
+    return NULL;
+  }
+  if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+      fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length)) != NULL &&
+      fread(data, 1, length, file) != (size_t)length) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  *size = data ? (size_t)length : 0;
+  return data;
+}
+
+static int in_file(size_t size, Elf32_Off offset, size_t length) {
+  return offset <= size && length <= size - offset;
+}
+
+/* Adds the code symbols of the symbol table in section index */
+static int add_symbols(const unsigned char *data, size_t size,
+                       const Elf32_Shdr *sections, Elf32_Half count,
+                       Elf32_Half index, int relocatable, Address base) {
+  const Elf32_Shdr *table = &sections[index], *strings, *section;
+  const Elf32_Sym *symbol;
+  const char *name;
+  size_t i, n = table->sh_size / sizeof(Elf32_Sym);
+  Symbol *grown;
+
+  if (table->sh_link >= count ||
+      !in_file(size, table->sh_offset, table->sh_size)) {
+    return -1;
+  }
+  strings = &sections[table->sh_link];
+  if (!in_file(size, strings->sh_offset, strings->sh_size) ||
+      strings->sh_size == 0 || data[strings->sh_offset + strings->sh_size - 1]) {
+    return -1;
+  }
+  grown = realloc(symbols, (symbol_count + n) * sizeof(*symbols));
+  if (grown == NULL) {
+    return -1;
+  }
+  symbols = grown;
+
+  for (i = 0; i < n; i++) {
+    symbol = (const Elf32_Sym *)(data + table->sh_offset) + i;
+    if (symbol->st_name >= strings->sh_size || symbol->st_shndx == SHN_UNDEF ||
+        symbol->st_shndx >= count) {
+      continue;
+    }
+    section = &sections[symbol->st_shndx];
+    name = (const char *)data + strings->sh_offset + symbol->st_name;
+    if (!(section->sh_flags & SHF_EXECINSTR) ||
+        (ELF32_ST_TYPE(symbol->st_info) != STT_FUNC &&
+         ELF32_ST_TYPE(symbol->st_info) != STT_NOTYPE) ||
+        name[0] == '\0' || name[0] == '$' || strncmp(name, ".L", 2) == 0) {
+      continue;
+    }
+    symbols[symbol_count].address =
+        symbol->st_value + (relocatable ? base + section->sh_addr : 0);
+    symbols[symbol_count].name = strdup(name);
+    if (symbols[symbol_count].name == NULL) {
+      return -1;
+    }
+    symbol_count++;
+  }
+  return 0;
+}
+
+/* Loads the symbols of an ELF file whose code is loaded at base. Returns 0
+ * on success. */
+int symbols_load(const char *filename, Address base) {
+  const Elf32_Ehdr *header;
+  const Elf32_Shdr *sections;
+  unsigned char *data;
+  size_t size;
+  Elf32_Half i;
+  int status = 0;
+
+  data = read_file(filename, &size);
+  if (data == NULL) {
+    fprintf(stderr, "Cannot read symbols from %s\n", filename);
+    return -1;
+  }
+  header = (const Elf32_Ehdr *)data;
+  if (size < sizeof(*header) || memcmp(header->e_ident, ELFMAG, SELFMAG) ||
+      header->e_ident[EI_CLASS] != ELFCLASS32 ||
+      header->e_ident[EI_DATA] != ELFDATA2LSB ||
+      header->e_machine != EM_RISCV ||
+      header->e_shentsize != sizeof(Elf32_Shdr) ||
+      !in_file(size, header->e_shoff,
+               (size_t)header->e_shnum * sizeof(Elf32_Shdr))) {
+    fprintf(stderr, "%s is not a 32-bit RISC-V ELF file\n", filename);
+    free(data);
+    return -1;
+  }
+  sections = (const Elf32_Shdr *)(data + header->e_shoff);
+  for (i = 0; i < header->e_shnum && status == 0; i++) {
+    if (sections[i].sh_type == SHT_SYMTAB) {
+      status = add_symbols(data, size, sections, header->e_shnum, i,
+                           header->e_type == ET_REL, base);
+    }
+  }
+  free(data);
+  if (status != 0) {
+    fprintf(stderr, "Bad symbol table in %s\n", filename);
+    return -1;
+  }
+  qsort(symbols, symbol_count, sizeof(*symbols), compare_symbols);
+  return 0;
+}
+
+/* Returns the name of the closest symbol at or below address and sets
+ * offset to the distance from it, or returns NULL if there is none */
+const char *symbols_find(Address address, Address *offset) {
+  size_t low = 0, high = symbol_count, middle;
+
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    if (symbols[middle].address <= address) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) {
+    return NULL;
+  }
+  *offset = address - symbols[low - 1].address;
+  return symbols[low - 1].name;
+}
+
+/* Names address as symbol, symbol+0xoffset or 0xaddress, as snprintf
+ * would */
+size_t symbols_format(char *buf, size_t size, Address address) {
+  Address offset;
+  const char *name = symbols_find(address, &offset);
+
+  if (name == NULL) {
+    return snprintf(buf, size, "0x%08x", address);
+  }
+  if (offset == 0) {
+    return snprintf(buf, size, "%s", name);
+  }
+  return snprintf(buf, size, "%s+0x%x", name, offset);
+}
@@ -0,0 +1,16 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Guest symbols for the profilers (--symbols=FILE). FILE is a 32-bit
+   RISC-V ELF file: an executable, whose symbols have their final
+   addresses, or an object file assembled from the .input program, whose
+   code symbols are offsets from the address the program is loaded at.
+   Local assembler labels (.L*) and mapping symbols ($x) are skipped. */
+int symbols_load(const char *filename, Address base);
+const char *symbols_find(Address address, Address *offset);
+size_t symbols_format(char *buf, size_t size, Address address);
+
+#endif
@@ -0,0 +1,251 @@
+#include "timing.h"
+#include "riscv.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TIMING_SLOTS (MEMORY_SPACE / 4)
+#define TIMING_FILL 4 /* cycles from the last EX to the end of WB, plus IF */
+
+enum { STALL_DATA, STALL_DIVIDER, STALL_CONTROL, STALL_KINDS };
+
+enum { LATENCY_LOAD, LATENCY_MUL, LATENCY_DIV, PENALTY_BRANCH, PENALTY_JUMP,
+       LATENCY_COUNT };
+
+/* A run of consecutive instructions that all executed */
+typedef struct {
+  Address start;
+  Word length;
+  Double retired;
+  Double cycles;
+} Region;
+
+static const char *const stall_names[STALL_KINDS] = {"data", "divider",
+                                                     "control"};
+static const char *const latency_names[LATENCY_COUNT] = {
+    "load", "mul", "div", "branch", "jump"};
+static Word latencies[LATENCY_COUNT] = {2, 3, 20, 2, 1};
+
+static char *timing_filename;
+static const Byte *timing_memory;
+static Double *timing_counts; /* instructions retired at each pc */
+static Double *timing_cycles; /* cycles charged to each pc */
+static Double ready[32];      /* cycle each register can be forwarded in */
+static Double ex_cycle;       /* cycle the last instruction entered EX */
+static Double divider_free;   /* cycle the divider can take a new op */
+static Double next_penalty;   /* bubbles before the next instruction */
+static Double instructions;
+static Double stalls[STALL_KINDS];
+
+/* Parses NAME:CYCLES, such as mul:4. Returns 0 on success. */
+int timing_configure(const char *arg) {
+  const char *colon = strchr(arg, ':');
+  char *end;
+  long cycles;
+  int i;
+
+  if (colon == NULL) {
+    return -1;
+  }
+  cycles = strtol(colon + 1, &end, 0);
+  if (end == colon + 1 || *end != '\0' || cycles < 0 || cycles > 1000) {
+    return -1;
+  }
+  for (i = 0; i < LATENCY_COUNT; i++) {
+    if (strlen(latency_names[i]) == (size_t)(colon - arg) &&
+        strncmp(arg, latency_names[i], colon - arg) == 0) {
+      /* results take at least a cycle to reach the next instruction */
+      if (i <= LATENCY_DIV && cycles < 1) {
+        return -1;
+      }
+      latencies[i] = cycles;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Starts timing a run. Returns 0 on success. */
+int timing_open(const char *filename, const Byte *memory) {
+  static int registered;
+
+  timing_filename = strdup(filename);
+  timing_counts = calloc(TIMING_SLOTS, sizeof(*timing_counts));
+  timing_cycles = calloc(TIMING_SLOTS, sizeof(*timing_cycles));
+  if (timing_filename == NULL || timing_counts == NULL ||
+      timing_cycles == NULL) {
+    fprintf(stderr, "Out of memory for the timing model\n");
+    return -1;
+  }
+  timing_memory = memory;
+  memset(ready, 0, sizeof(ready));
+  ex_cycle = divider_free = next_penalty = instructions = 0;
+  memset(stalls, 0, sizeof(stalls));
+  if (!registered) {
+    atexit(timing_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+static Double later(Double a, Double b) { return a > b ? a : b; }
+
+/* Places the instruction of event in the pipeline. Each instruction enters
+ * EX a cycle after the one before it unless it waits for an operand, the
+ * divider or the refetch after a taken branch. */
+void timing_retire(const RetireEvent *event) {
+  Word opcode = event->bits & 0x7f, funct3 = event->bits >> 12 & 0x7;
+  int rd = event_destination(event->bits), rs1, rs2, is_div = 0;
+  Double issue = ex_cycle + 1 + next_penalty, start = issue;
+
+  stalls[STALL_CONTROL] += next_penalty;
+  next_penalty = 0;
+
+  event_sources(event->bits, &rs1, &rs2);
+  start = later(start, later(ready[rs1], ready[rs2]));
+  stalls[STALL_DATA] += start - issue;
+
+  if (opcode == 0x33 && event->bits >> 25 == 0x1 && funct3 >= 4) {
+    is_div = 1;
+    if (divider_free > start) {
+      stalls[STALL_DIVIDER] += divider_free - start;
+      start = divider_free;
+    }
+    divider_free = start + latencies[LATENCY_DIV];
+  }
+
+  if (rd) {
+    if (opcode == 0x03) {
+      ready[rd] = start + latencies[LATENCY_LOAD];
+    } else if (is_div) {
+      ready[rd] = start + latencies[LATENCY_DIV];
+    } else if (opcode == 0x33 && event->bits >> 25 == 0x1) {
+      ready[rd] = start + latencies[LATENCY_MUL];
+    } else {
+      ready[rd] = start + 1;
+    }
+  }
+
+  if (opcode == 0x6f) {
+    next_penalty = latencies[PENALTY_JUMP];
+  } else if ((opcode == 0x63 && event->next_pc != event->pc + 4) ||
+             opcode == 0x67) {
+    next_penalty = latencies[PENALTY_BRANCH];
+  }
+
+  if (event->pc < MEMORY_SPACE) {
+    timing_counts[event->pc >> 2]++;
+    timing_cycles[event->pc >> 2] += start - ex_cycle;
+  }
+  ex_cycle = start;
+  instructions++;
+}
+
+static double cpi(Double cycles, Double retired) {
+  return retired ? (double)cycles / retired : 0.0;
+}
+
+static int compare_regions(const void *a, const void *b) {
+  const Region *x = a, *y = b;
+
+  return x->cycles < y->cycles ? 1 : x->cycles > y->cycles ? -1 : 0;
+}
+
+/* Splits the executed code into runs of consecutive addresses */
+static Region *find_regions(Word *count) {
+  Region *regions = NULL, *region = NULL;
+  Word slot, size = 0;
+
+  *count = 0;
+  for (slot = 0; slot < TIMING_SLOTS; slot++) {
+    if (timing_counts[slot] == 0) {
+      region = NULL;
+      continue;
+    }
+    if (region == NULL) {
+      if (*count == size) {
+        size = size ? 2 * size : 64;
+        regions = realloc(regions, size * sizeof(*regions));
+        if (regions == NULL) {
+          fprintf(stderr, "Out of memory for the timing report\n");
+          exit(-1);
+        }
+      }
+      region = &regions[(*count)++];
+      region->start = 4 * slot;
+      region->length = 0;
+      region->retired = 0;
+      region->cycles = 0;
+    }
+    region->length++;
+    region->retired += timing_counts[slot];
+    region->cycles += timing_cycles[slot];
+  }
+  return regions;
+}
+
+static void write_report(FILE *out) {
+  char line[DISASM_LINE_MAX];
+  Double cycles = instructions ? ex_cycle + TIMING_FILL : 0;
+  Region *regions;
+  Word count, i, bits;
+  int kind;
+
+  fprintf(out, "%llu instructions, %llu cycles, CPI %.3f\n",
+          (unsigned long long)instructions, (unsigned long long)cycles,
+          cpi(cycles, instructions));
+  fprintf(out, "latencies:");
+  for (i = 0; i < LATENCY_COUNT; i++) {
+    fprintf(out, " %s %u", latency_names[i], latencies[i]);
+  }
+  fprintf(out, "\n\nStall cycles\n");
+  for (kind = 0; kind < STALL_KINDS; kind++) {
+    fprintf(out, "%-8s %14llu %6.2f%%\n", stall_names[kind],
+            (unsigned long long)stalls[kind],
+            cycles ? 100.0 * stalls[kind] / cycles : 0.0);
+  }
+
+  regions = find_regions(&count);
+  qsort(regions, count, sizeof(*regions), compare_regions);
+  fprintf(out, "\nHot regions\n");
+  fprintf(out, "%-17s %14s %14s %7s %8s  first instruction\n", "region",
+          "instructions", "cycles", "cycle%", "CPI");
+  for (i = 0; i < count && i < TIMING_TOP_REGIONS; i++) {
+    memcpy(&bits, timing_memory + regions[i].start, sizeof(bits));
+    if (is_known_opcode(bits & 0x7f)) {
+      format_instruction(line, sizeof(line), bits);
+    } else {
+      strcpy(line, "(overwritten)\n");
+    }
+    fprintf(out, "%08x-%08x %14llu %14llu %6.2f%% %8.3f  %s",
+            regions[i].start,
+            regions[i].start + 4 * (regions[i].length - 1),
+            (unsigned long long)regions[i].retired,
+            (unsigned long long)regions[i].cycles,
+            cycles ? 100.0 * regions[i].cycles / cycles : 0.0,
+            cpi(regions[i].cycles, regions[i].retired), line);
+  }
+  free(regions);
+}
+
+/* Writes the report. Called at exit. */
+void timing_close(void) {
+  FILE *out;
+
+  if (timing_counts == NULL) {
+    return;
+  }
+  out = fopen(timing_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot create timing report %s\n", timing_filename);
+  } else {
+    write_report(out);
+    fclose(out);
+  }
+  free(timing_counts);
+  free(timing_cycles);
+  free(timing_filename);
+  timing_counts = timing_cycles = NULL;
+  timing_filename = NULL;
+}
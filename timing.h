@@ -0,0 +1,23 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "event.h"
+#include "types.h"
+
+/* In-order pipeline timing model (--timing=FILE). A classic five-stage
+   IF/ID/EX/MEM/WB pipeline with full forwarding is replayed from the
+   RetireEvent of each instruction, so the functional handlers know nothing
+   about it. Loads deliver their result load cycles after entering EX, mul
+   after mul cycles, and div and rem hold EX for div cycles. Branches are
+   predicted not taken and resolved in EX; a taken branch or jalr costs
+   branch cycles and a jal, resolved in ID, jump cycles. Latencies are set
+   with --timing-config=NAME:CYCLES. At exit FILE gets the cycle count and
+   CPI of the run, the stalls by cause and the hottest code regions. */
+#define TIMING_TOP_REGIONS 10
+
+int timing_configure(const char *arg);
+int timing_open(const char *filename, const Byte *memory);
+void timing_retire(const RetireEvent *event);
+void timing_close(void);
+
+#endif
@@ -0,0 +1,385 @@
+#include "trace.h"
+#include "ring.h"
+#include "tracez.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+static FILE *trace_file;
+static TraceFormat trace_format;
+static Word trace_flags;
+static int trace_exited;
+
+/* delta trace state */
+static Double trace_count;    /* instructions recorded so far */
+static Double trace_offset;   /* bytes written so far */
+static Double trace_interval = TRACE_DEFAULT_KEYFRAME_INTERVAL;
+static TraceIndexEntry *trace_index;
+static Double trace_index_count, trace_index_size;
+static int trace_resync; /* a step was dropped, see trace_retire() */
+static Address trace_resync_pc;
+static Register trace_resync_R[32];
+
+/* asynchronous writer state, see trace_set_async() */
+static size_t trace_ring_size;
+static int trace_drop;
+static int trace_async;
+static int trace_stopping;
+static Double trace_dropped;
+static Ring trace_ring;
+static pthread_t trace_thread;
+
+/* compression state, see trace_set_compress() */
+static int trace_compress;
+static TraceCompressor trace_z;
+
+static void trace_output(const void *data, size_t size) {
+  if (fwrite(data, 1, size, trace_file) != size) {
+    fprintf(stderr, "Error writing trace\n");
+    exit(-1);
+  }
+}
+
+/* Takes records in order, on the writer thread if there is one */
+static void trace_sink(const void *data, size_t size) {
+  if (trace_compress) {
+    tracez_write(&trace_z, data, size);
+  } else {
+    trace_output(data, size);
+  }
+}
+
+/* Writes one record. When the ring is full it either waits for the writer
+ * thread or, with the drop policy, counts the record as dropped and returns
+ * 0. */
+static int trace_write(const void *data, size_t size) {
+  if (!trace_async) {
+    trace_sink(data, size);
+  } else {
+    while (!ring_push(&trace_ring, data, size)) {
+      if (trace_drop) {
+        trace_dropped++;
+        return 0;
+      }
+      sched_yield();
+    }
+  }
+  trace_offset += size;
+  return 1;
+}
+
+/* Drains the ring to the trace file in as large writes as are available */
+static void *trace_writer(void *arg) {
+  const void *data;
+  size_t len;
+
+  for (;;) {
+    len = ring_peek(&trace_ring, &data);
+    if (len > 0) {
+      trace_sink(data, len);
+      ring_consume(&trace_ring, len);
+    } else if (__atomic_load_n(&trace_stopping, __ATOMIC_ACQUIRE)) {
+      if (ring_empty(&trace_ring)) {
+        break;
+      }
+    } else {
+      usleep(100);
+    }
+  }
+  return NULL;
+}
+
+/* Writes a keyframe of the state after trace_count instructions. Returns 0
+ * if it was dropped. */
+static int trace_keyframe(Address pc, const Register *R) {
+  TraceKeyframe keyframe;
+
+  if (trace_index_count == trace_index_size) {
+    trace_index_size = trace_index_size ? 2 * trace_index_size : 64;
+    trace_index = realloc(trace_index, trace_index_size * sizeof(*trace_index));
+    if (trace_index == NULL) {
+      fprintf(stderr, "Out of memory recording trace\n");
+      exit(-1);
+    }
+  }
+
+  memset(&keyframe, 0, sizeof(keyframe));
+  keyframe.tag = TRACE_TAG(TRACE_KEYFRAME, 0);
+  keyframe.index = trace_count;
+  keyframe.pc = pc;
+  memcpy(keyframe.R, R, sizeof(keyframe.R));
+
+  /* only index keyframes that made it into the file */
+  trace_index[trace_index_count].index = trace_count;
+  trace_index[trace_index_count].offset = trace_offset;
+  if (!trace_write(&keyframe, sizeof(keyframe))) {
+    return 0;
+  }
+  trace_index_count++;
+  return 1;
+}
+
+/* Parses a --trace-format name. Returns 0 on success. */
+int trace_parse_format(const char *name, TraceFormat *format) {
+  if (strcmp(name, "text") == 0) {
+    *format = TRACE_TEXT;
+  } else if (strcmp(name, "bin") == 0) {
+    *format = TRACE_BIN;
+  } else if (strcmp(name, "delta") == 0) {
+    *format = TRACE_DELTA;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/* Starts a trace in the given format. A NULL or "-" filename traces to
+ * stdout, where text traces stay interleaved with the guest's output. The
+ * trace is flushed when the simulator exits. */
+int trace_open(const char *filename, TraceFormat format) {
+  static int registered;
+  TraceHeader header;
+
+  if (filename == NULL || strcmp(filename, "-") == 0) {
+    trace_file = stdout;
+  } else {
+    trace_file = fopen(filename, "wb");
+    if (trace_file == NULL) {
+      fprintf(stderr, "Cannot create trace %s\n", filename);
+      return -1;
+    }
+    setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+  }
+  trace_format = format;
+  trace_count = 0;
+  trace_offset = 0;
+  trace_index_count = 0;
+  trace_resync = 0;
+  trace_exited = 0;
+  if (format == TRACE_TEXT) {
+    trace_compress = 0;
+  }
+
+  /* the header is never compressed or queued */
+  if (format != TRACE_TEXT) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.byte_order = TRACE_BYTE_ORDER;
+    header.format = format;
+    header.record_size = format == TRACE_BIN ? sizeof(TraceRetire) : 0;
+    header.flags = trace_flags = trace_compress ? TRACE_COMPRESSED : 0;
+    trace_output(&header, sizeof(header));
+    trace_offset = sizeof(header);
+  }
+  if (trace_compress &&
+      tracez_init(&trace_z, format, trace_output, sizeof(header)) != 0) {
+    fprintf(stderr, "Out of memory compressing trace\n");
+    return -1;
+  }
+
+  if (trace_ring_size && trace_file != stdout) {
+    if (ring_init(&trace_ring, trace_ring_size) != 0 ||
+        pthread_create(&trace_thread, NULL, trace_writer, NULL) != 0) {
+      fprintf(stderr, "Cannot start the trace writer\n");
+      return -1;
+    }
+    trace_async = 1;
+  }
+
+  if (!registered) {
+    atexit(trace_close);
+    registered = 1;
+  }
+  return 0;
+}
+
+/* Makes traces written to a file go through a ring of ring_size bytes that
+ * a background thread drains, so the simulator does not stall when the disk
+ * does. With drop set, records that do not fit are counted and discarded
+ * instead of waiting. Must be called before trace_open(). */
+void trace_set_async(size_t ring_size, int drop) {
+  trace_ring_size = ring_size < TRACE_MIN_RING ? TRACE_MIN_RING : ring_size;
+  trace_drop = drop;
+}
+
+/* Compresses binary and delta traces as they are written, see tracez.h.
+ * Must be called before trace_open(). */
+void trace_set_compress(int compress) {
+  trace_compress = compress;
+}
+
+/* Sets how many instructions apart delta trace keyframes are */
+void trace_set_keyframe_interval(Double interval) {
+  trace_interval = interval ? interval : 1;
+}
+
+/* Records the state execution starts from. Delta traces need it as their
+ * first keyframe; the other formats ignore it. */
+void trace_begin(const Processor *processor) {
+  if (trace_format == TRACE_DELTA) {
+    trace_resync = !trace_keyframe(processor->PC, processor->R);
+  }
+}
+
+/* Records an instruction that has just been executed */
+void trace_retire(const RetireEvent *event, const Processor *processor) {
+  char text[TRACE_TEXT_SIZE];
+  TraceRetire record;
+  struct {
+    TraceStep step;
+    TraceMemWrite write;
+  } delta;
+
+  switch (trace_format) {
+  case TRACE_TEXT:
+    trace_write(text, trace_format_text(text, processor->R));
+    break;
+  case TRACE_BIN:
+    record.pc = event->pc;
+    memcpy(record.R, processor->R, sizeof(record.R));
+    trace_write(&record, sizeof(record));
+    break;
+  case TRACE_DELTA:
+    trace_count++;
+    /* steps only make sense on top of the ones before them, so after a
+     * drop the registers are written out whole until that succeeds */
+    if (trace_resync) {
+      trace_resync = !trace_keyframe(processor->PC, processor->R);
+    } else {
+      /* a step and its memory write are kept or dropped together */
+      delta.step.tag = TRACE_TAG(TRACE_STEP, event->rd);
+      delta.step.pc = event->pc;
+      delta.step.bits = event->bits;
+      delta.step.value = event->rd_value;
+      if (event->mem_write) {
+        delta.write.tag = TRACE_TAG(TRACE_MEM_WRITE, event->mem_size);
+        delta.write.address = event->mem_addr;
+        delta.write.value = event->mem_value;
+        trace_resync = !trace_write(&delta, sizeof(delta));
+      } else {
+        trace_resync = !trace_write(&delta.step, sizeof(delta.step));
+      }
+      if (!trace_resync && trace_count % trace_interval == 0) {
+        trace_keyframe(processor->PC, processor->R);
+      }
+    }
+    if (trace_resync) {
+      /* trace_close() writes this if the run ends before a keyframe fits */
+      trace_resync_pc = processor->PC;
+      memcpy(trace_resync_R, processor->R, sizeof(trace_resync_R));
+    }
+    break;
+  }
+}
+
+static void trace_write_index(void) {
+  TraceIndex trailer;
+
+  trailer.count = trace_index_count;
+  trailer.offset = trace_offset;
+  memcpy(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic));
+  trace_write(trace_index, trace_index_count * sizeof(*trace_index));
+  trace_write(&trailer, sizeof(trailer));
+}
+
+/* Notes that the program ended with the exit ecall, which -r prints as
+ * "exiting the simulator" */
+void trace_exit(void) { trace_exited = 1; }
+
+/* Sets TRACE_EXITED in the header once everything else is written. Traces
+ * piped to another program cannot be rewritten and are left unmarked. */
+static void trace_mark_exited(void) {
+  trace_flags |= TRACE_EXITED;
+  if (fflush(trace_file) == 0 &&
+      fseek(trace_file, offsetof(TraceHeader, flags), SEEK_SET) == 0) {
+    trace_output(&trace_flags, sizeof(trace_flags));
+  }
+}
+
+void trace_close(void) {
+  if (trace_file == NULL) {
+    return;
+  }
+  /* the index can be larger than the ring, so it is written after the
+   * writer thread has drained it */
+  if (trace_async) {
+    __atomic_store_n(&trace_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(trace_thread, NULL);
+    ring_destroy(&trace_ring);
+    trace_async = 0;
+    trace_stopping = 0;
+    if (trace_dropped) {
+      fprintf(stderr, "Dropped %llu trace records\n",
+              (unsigned long long)trace_dropped);
+    }
+  }
+  if (trace_format == TRACE_DELTA && trace_resync) {
+    trace_keyframe(trace_resync_pc, trace_resync_R);
+  }
+  if (trace_format == TRACE_DELTA && !trace_compress) {
+    trace_write_index();
+  }
+  free(trace_index);
+  trace_index = NULL;
+  trace_index_size = 0;
+  if (trace_compress) {
+    tracez_finish(&trace_z);
+    trace_compress = 0;
+  }
+  if (trace_exited && trace_format != TRACE_TEXT) {
+    trace_mark_exited();
+  }
+  if (trace_file == stdout) {
+    fflush(trace_file);
+  } else if (fclose(trace_file) != 0) {
+    fprintf(stderr, "Error writing trace\n");
+  }
+  trace_file = NULL;
+}
+
+/* Formats one register dump exactly as "r%2d=%08x " four to a line, followed
+ * by a blank line. buf must hold TRACE_TEXT_SIZE bytes; returns the length. */
+size_t trace_format_text(char *buf, const Register *R) {
+  static const char hex[] = "0123456789abcdef";
+  char *out = buf;
+  int i, j, k;
+
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < 4; j++) {
+      int r = i * 4 + j;
+
+      *out++ = 'r';
+      *out++ = r < 10 ? ' ' : '0' + r / 10;
+      *out++ = '0' + r % 10;
+      *out++ = '=';
+      for (k = 7; k >= 0; k--) {
+        *out++ = hex[(R[r] >> (4 * k)) & 0xf];
+      }
+      *out++ = ' ';
+    }
+    *out++ = '\n';
+  }
+  *out++ = '\n';
+  return out - buf;
+}
+
+/* Validates the header at the start of a binary trace. Returns 0 if it can
+ * be read on this host. */
+int trace_read_header(const void *data, size_t size, TraceHeader *header) {
+  if (size < sizeof(*header)) {
+    return -1;
+  }
+  memcpy(header, data, sizeof(*header));
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != TRACE_VERSION ||
+      header->byte_order != TRACE_BYTE_ORDER) {
+    return -1;
+  }
+  return 0;
+}
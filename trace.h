@@ -0,0 +1,116 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include "event.h"
+#include "types.h"
+
+/* Register trace formats */
+typedef enum {
+  TRACE_TEXT,  /* the -r register dump */
+  TRACE_BIN,   /* TraceHeader followed by one TraceRetire per instruction */
+  TRACE_DELTA, /* TraceHeader, tagged records (see below) and TraceIndex */
+} TraceFormat;
+
+/* Binary traces start with this header. All fields are stored in host byte
+   order; byte_order lets readers detect a trace from a different host. */
+#define TRACE_MAGIC "RVTRACE\0"
+#define TRACE_VERSION 2
+#define TRACE_BYTE_ORDER 0x01020304
+
+/* TraceHeader flags */
+#define TRACE_COMPRESSED 0x1 /* records are packed in chunks, see tracez.h */
+#define TRACE_EXITED 0x2     /* the program ended with the exit ecall */
+
+typedef struct {
+  char magic[8];
+  Word version;
+  Word byte_order;
+  Word format;      /* a TraceFormat */
+  Word record_size; /* sizeof(TraceRetire) for TRACE_BIN, 0 for TRACE_DELTA */
+  Word flags;
+  Word reserved;
+} TraceHeader;
+
+/* One retired instruction: its address and the register file after it */
+typedef struct {
+  Address pc;
+  Register R[32];
+} TraceRetire;
+
+/* Delta traces only record what changed. Every record starts with a tag
+   word whose low byte is one of the kinds below. A step is followed by a
+   memory write record if the instruction stored to memory. Keyframes hold
+   the full register state before instruction `index` and are written every
+   keyframe interval, so a reader can start from any of them. When records
+   are dropped (--trace-drop) the next record written is a keyframe, and its
+   index shows which instructions are missing. */
+enum {
+  TRACE_STEP = 1,
+  TRACE_MEM_WRITE,
+  TRACE_KEYFRAME,
+};
+
+#define TRACE_TAG(kind, arg) ((kind) | ((arg) << 8))
+#define TRACE_TAG_KIND(tag) ((tag) & 0xff)
+#define TRACE_TAG_ARG(tag) (((tag) >> 8) & 0xff)
+
+typedef struct {
+  Word tag; /* TRACE_TAG(TRACE_STEP, rd), rd is 0 if no register changed */
+  Address pc;
+  Word bits;
+  Word value; /* new value of rd */
+} TraceStep;
+
+typedef struct {
+  Word tag; /* TRACE_TAG(TRACE_MEM_WRITE, size in bytes) */
+  Address address;
+  Word value;
+} TraceMemWrite;
+
+typedef struct {
+  Word tag; /* TRACE_TAG(TRACE_KEYFRAME, 0) */
+  Word reserved;
+  Double index;
+  Address pc;
+  Register R[32];
+} TraceKeyframe;
+
+/* A delta trace ends with an array of count TraceIndexEntry, one per
+   keyframe, followed by this trailer (compressed traces use the chunk
+   index described in tracez.h instead) */
+#define TRACE_INDEX_MAGIC "RVTRIDX\0"
+
+typedef struct {
+  Double index;  /* instruction index of the keyframe */
+  Double offset; /* file offset of the keyframe */
+} TraceIndexEntry;
+
+typedef struct {
+  Double count;
+  Double offset; /* file offset of the first TraceIndexEntry */
+  char magic[8];
+} TraceIndex;
+
+#define TRACE_DEFAULT_KEYFRAME_INTERVAL 65536
+
+/* Smallest ring trace_set_async() accepts; it must hold any single record */
+#define TRACE_MIN_RING 4096
+
+/* Length of one register dump in the text format */
+#define TRACE_TEXT_SIZE (8 * (4 * 13 + 1) + 1)
+
+int trace_parse_format(const char *name, TraceFormat *format);
+int trace_open(const char *filename, TraceFormat format);
+void trace_set_async(size_t ring_size, int drop);
+void trace_set_compress(int compress);
+void trace_set_keyframe_interval(Double interval);
+void trace_begin(const Processor *processor);
+void trace_retire(const RetireEvent *event, const Processor *processor);
+void trace_exit(void);
+void trace_close(void);
+
+size_t trace_format_text(char *buf, const Register *R);
+int trace_read_header(const void *data, size_t size, TraceHeader *header);
+
+#endif
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include "traceread.h"
+#include "tracez.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Reads the index trailer at the end of the file. Returns 0 if there is a
+ * valid one with the given magic. */
+static int read_index(const TraceReader *reader, const char *magic,
+                      TraceIndex *trailer) {
+  if (reader->size < sizeof(TraceHeader) + sizeof(*trailer)) {
+    return -1;
+  }
+  memcpy(trailer, reader->data + reader->size - sizeof(*trailer),
+         sizeof(*trailer));
+  if (memcmp(trailer->magic, magic, sizeof(trailer->magic)) != 0 ||
+      trailer->offset + trailer->count * sizeof(TraceIndexEntry) +
+              sizeof(*trailer) !=
+          reader->size) {
+    return -1;
+  }
+  return 0;
+}
+
+/* Returns the file offset of the last index entry at or before first and
+ * sets *index to the instruction it starts at */
+static Double seek_index(const TraceReader *reader, const TraceIndex *trailer,
+                         Double first, Double *index) {
+  TraceIndexEntry entry;
+  Double lo = 0, hi = trailer->count, mid;
+
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    memcpy(&entry, reader->data + trailer->offset + mid * sizeof(entry),
+           sizeof(entry));
+    if (entry.index <= first) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  memcpy(&entry, reader->data + trailer->offset + lo * sizeof(entry),
+         sizeof(entry));
+  *index = entry.index;
+  return entry.offset;
+}
+
+static const char *index_magic(const TraceReader *reader) {
+  return reader->header.flags & TRACE_COMPRESSED ? TRACEZ_INDEX_MAGIC
+                                                 : TRACE_INDEX_MAGIC;
+}
+
+/* Maps filename and works out its format. Returns 0 on success. */
+int trace_reader_open(TraceReader *reader, const char *filename) {
+  TraceIndex trailer;
+  struct stat st;
+  void *data;
+  int fd;
+
+  memset(reader, 0, sizeof(*reader));
+  fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Cannot open trace %s\n", filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  data = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : NULL;
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Cannot map trace %s\n", filename);
+    return -1;
+  }
+  reader->data = data;
+  reader->size = st.st_size;
+  reader->end = st.st_size;
+  if (data) {
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+  }
+
+  if (trace_read_header(reader->data, reader->size, &reader->header) != 0) {
+    /* anything else is taken to be a -r register dump */
+    memset(&reader->header, 0, sizeof(reader->header));
+    reader->header.format = TRACE_TEXT;
+    return 0;
+  }
+  if ((reader->header.format != TRACE_BIN &&
+       reader->header.format != TRACE_DELTA) ||
+      (reader->header.format == TRACE_BIN &&
+       reader->header.record_size != sizeof(TraceRetire))) {
+    fprintf(stderr, "%s: unsupported trace format %u\n", filename,
+            reader->header.format);
+    trace_reader_close(reader);
+    return -1;
+  }
+  reader->pos = sizeof(TraceHeader);
+  if ((reader->header.format == TRACE_DELTA ||
+       (reader->header.flags & TRACE_COMPRESSED)) &&
+      read_index(reader, index_magic(reader), &trailer) == 0) {
+    reader->end = trailer.offset;
+  }
+  return 0;
+}
+
+void trace_reader_close(TraceReader *reader) {
+  if (reader->data) {
+    munmap((void *)reader->data, reader->size);
+  }
+  free(reader->raw);
+  free(reader->scratch);
+  memset(reader, 0, sizeof(*reader));
+}
+
+/* Decodes the next chunk of a compressed trace. Returns 1 if one was
+ * loaded, 0 at the end of the trace and -1 if it is corrupt. */
+static int load_chunk(TraceReader *reader) {
+  TraceChunk chunk;
+
+  if (reader->pos + sizeof(chunk) > reader->end) {
+    return 0;
+  }
+  memcpy(&chunk, reader->data + reader->pos, sizeof(chunk));
+  if (chunk.size > reader->end - reader->pos - sizeof(chunk)) {
+    return 0; /* the simulator was killed mid-chunk */
+  }
+  if (chunk.raw_size > reader->raw_capacity) {
+    reader->raw_capacity = chunk.raw_size;
+    reader->raw = realloc(reader->raw, reader->raw_capacity);
+  }
+  if (chunk.varint_size > reader->scratch_capacity) {
+    reader->scratch_capacity = chunk.varint_size;
+    reader->scratch = realloc(reader->scratch, reader->scratch_capacity);
+  }
+  if ((reader->raw_capacity && reader->raw == NULL) ||
+      (reader->scratch_capacity && reader->scratch == NULL)) {
+    fprintf(stderr, "Out of memory reading trace\n");
+    return -1;
+  }
+  if (tracez_decode_chunk(reader->header.format, &chunk,
+                          reader->data + reader->pos + sizeof(chunk),
+                          reader->raw, reader->scratch) != 0) {
+    fprintf(stderr, "Corrupt trace chunk at offset %zu\n", reader->pos);
+    return -1;
+  }
+  reader->pos += sizeof(chunk) + chunk.size;
+  reader->raw_pos = 0;
+  reader->raw_len = chunk.raw_size;
+  if (reader->header.format == TRACE_BIN) {
+    reader->index = chunk.first;
+  }
+  return 1;
+}
+
+/* Points *records at the unread records and sets *len to their length, 0
+ * at the end of the trace. Returns -1 if the trace is corrupt. */
+static int reader_records(TraceReader *reader, const Byte **records,
+                          size_t *len) {
+  int status;
+
+  if (!(reader->header.flags & TRACE_COMPRESSED)) {
+    *records = reader->data + reader->pos;
+    *len = reader->end - reader->pos;
+    return 0;
+  }
+  while (reader->raw_pos == reader->raw_len) {
+    status = load_chunk(reader);
+    if (status <= 0) {
+      *len = 0;
+      return status;
+    }
+  }
+  *records = reader->raw + reader->raw_pos;
+  *len = reader->raw_len - reader->raw_pos;
+  return 0;
+}
+
+static void reader_consume(TraceReader *reader, size_t len) {
+  if (reader->header.flags & TRACE_COMPRESSED) {
+    reader->raw_pos += len;
+  } else {
+    reader->pos += len;
+  }
+}
+
+static int next_bin(TraceReader *reader) {
+  TraceRetire record;
+  const Byte *records;
+  size_t len;
+
+  if (reader_records(reader, &records, &len) != 0) {
+    return -1;
+  }
+  if (len < sizeof(record)) {
+    return 0;
+  }
+  memcpy(&record, records, sizeof(record));
+  reader->pc = record.pc;
+  memcpy(reader->R, record.R, sizeof(reader->R));
+  reader_consume(reader, sizeof(record));
+  reader->index++;
+  return 1;
+}
+
+/* Applies delta records up to the next step without consuming it. Returns
+ * the size of the step, 0 at the end of the trace or -1 if it is corrupt. */
+static long read_to_step(TraceReader *reader) {
+  TraceKeyframe keyframe;
+  const Byte *records;
+  size_t len, size;
+
+  for (;;) {
+    if (reader_records(reader, &records, &len) != 0) {
+      return -1;
+    }
+    if (len == 0) {
+      return 0;
+    }
+    size = tracez_record_size(TRACE_DELTA, records, len);
+    if (size == 0 && len >= sizeof(Word)) {
+      fprintf(stderr, "Corrupt trace record\n");
+      return -1;
+    }
+    if (size == 0 || size > len) {
+      return 0; /* the simulator was killed mid-record */
+    }
+    switch (TRACE_TAG_KIND(records[0])) {
+    case TRACE_STEP:
+      return size;
+    case TRACE_KEYFRAME:
+      memcpy(&keyframe, records, sizeof(keyframe));
+      /* the simulator writes a keyframe after records it had to drop */
+      if (keyframe.index > reader->index) {
+        fprintf(stderr, "Trace is missing instructions %llu to %llu\n",
+                (unsigned long long)reader->index,
+                (unsigned long long)keyframe.index - 1);
+        reader->skipped += keyframe.index - reader->index;
+      }
+      memcpy(reader->R, keyframe.R, sizeof(reader->R));
+      reader->pc = keyframe.pc;
+      reader->index = keyframe.index;
+      break;
+    }
+    reader_consume(reader, size);
+  }
+}
+
+static int next_delta(TraceReader *reader) {
+  const Byte *records;
+  TraceStep step;
+  size_t len;
+  long size = read_to_step(reader);
+
+  if (size <= 0) {
+    return size;
+  }
+  reader_records(reader, &records, &len);
+  memcpy(&step, records, sizeof(step));
+  reader->R[TRACE_TAG_ARG(step.tag) & 0x1f] = step.value;
+  reader->R[0] = 0;
+  reader->pc = step.pc;
+  reader_consume(reader, size);
+  reader->index++;
+  return 1;
+}
+
+/* Parses the eight lines of one register dump. Console output printed by
+ * the program may precede a line, so only the "=value" fields are read. */
+static int next_text(TraceReader *reader) {
+  const char *line, *p, *eol, *newline;
+  int row = 0, col;
+  char *endp;
+
+  while (row < 8) {
+    if (reader->pos >= reader->size) {
+      return 0;
+    }
+    line = (const char *)reader->data + reader->pos;
+    newline = memchr(line, '\n', reader->size - reader->pos);
+    eol = newline ? newline : (const char *)reader->data + reader->size;
+    reader->pos = newline ? newline + 1 - (const char *)reader->data
+                          : reader->size;
+    if (eol == line && row == 0) {
+      continue; /* blank line between dumps */
+    }
+    if (memmem(line, eol - line, "exiting", 7)) {
+      return 0;
+    }
+    if (memmem(line, eol - line, "Invalid", 7)) {
+      fprintf(stderr, "Invalid instruction in trace: %.*s\n",
+              (int)(eol - line), line);
+      return -1;
+    }
+    for (col = 0, p = line; col < 4; col++, p = endp) {
+      p = memchr(p, '=', eol - p);
+      if (p == NULL) {
+        break;
+      }
+      reader->R[row * 4 + col] = strtoul(p + 1, &endp, 16);
+    }
+    if (col < 4) {
+      fprintf(stderr, "Cannot parse trace line: %.*s\n", (int)(eol - line),
+              line);
+      return -1;
+    }
+    row++;
+  }
+  reader->index++;
+  return 1;
+}
+
+/* Reads the register file after the next instruction. Returns 1 on
+ * success, 0 at the end of the trace and -1 if it is corrupt. */
+int trace_reader_next(TraceReader *reader) {
+  switch (reader->header.format) {
+  case TRACE_BIN:
+    return next_bin(reader);
+  case TRACE_DELTA:
+    return next_delta(reader);
+  default:
+    return next_text(reader);
+  }
+}
+
+/* Skips to instruction first, using the keyframe or chunk index where
+ * there is one. Only valid on a freshly opened reader. */
+int trace_reader_seek(TraceReader *reader, Double first) {
+  TraceIndex trailer;
+  const Byte *records;
+  size_t len;
+  Double total;
+
+  if (reader->header.format == TRACE_BIN &&
+      !(reader->header.flags & TRACE_COMPRESSED)) {
+    /* fixed-size records, jump straight to the first one */
+    total = (reader->end - reader->pos) / sizeof(TraceRetire);
+    reader->index = first < total ? first : total;
+    reader->pos += reader->index * sizeof(TraceRetire);
+    return 0;
+  }
+  if (reader->header.format != TRACE_TEXT &&
+      read_index(reader, index_magic(reader), &trailer) == 0 &&
+      trailer.count > 0) {
+    reader->pos = seek_index(reader, &trailer, first, &reader->index);
+  }
+
+  /* load the chunk or keyframe we landed on so that index is exact */
+  if (reader->header.format == TRACE_DELTA) {
+    if (read_to_step(reader) < 0) {
+      return -1;
+    }
+  } else if (reader->header.format == TRACE_BIN &&
+             reader_records(reader, &records, &len) != 0) {
+    return -1;
+  }
+
+  while (reader->index < first) {
+    switch (trace_reader_next(reader)) {
+    case -1:
+      return -1;
+    case 0:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/* Continues reading an uncompressed trace from byte pos, which must be the
+ * start of the record of instruction index */
+void trace_reader_jump(TraceReader *reader, size_t pos, Double index) {
+  reader->pos = pos;
+  reader->index = index;
+}
@@ -0,0 +1,33 @@
+#ifndef TRACEREAD_H
+#define TRACEREAD_H
+
+#include <stddef.h>
+#include "trace.h"
+#include "types.h"
+
+/* Sequential reader over a trace file of any format, used by rvtrace and
+   rvcmp. The file is mapped once; each trace_reader_next() yields the
+   register file after one more instruction. */
+typedef struct {
+  const Byte *data;
+  size_t size;
+  TraceHeader header; /* format is TRACE_TEXT for -r dumps */
+  size_t pos;         /* next unread byte of data */
+  size_t end;         /* end of the records (start of any index) */
+  Byte *raw;          /* current chunk of a compressed trace */
+  size_t raw_pos, raw_len, raw_capacity;
+  Byte *scratch;
+  size_t scratch_capacity;
+  Register R[32];
+  Address pc;         /* of the last instruction, 0 in text traces */
+  Double index;       /* instructions read so far */
+  Double skipped;     /* instructions dropped from a delta trace */
+} TraceReader;
+
+int trace_reader_open(TraceReader *reader, const char *filename);
+void trace_reader_close(TraceReader *reader);
+int trace_reader_seek(TraceReader *reader, Double first);
+void trace_reader_jump(TraceReader *reader, size_t pos, Double index);
+int trace_reader_next(TraceReader *reader);
+
+#endif
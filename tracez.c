@@ -0,0 +1,466 @@
+#include "tracez.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+/* Longest record in words (a keyframe) and the number of record kinds */
+#define MAX_WORDS (sizeof(TraceKeyframe) / sizeof(Word))
+#define NUM_KINDS 4
+
+/* Room for a chunk plus the record that overflows it and a keyframe */
+#define RAW_CAPACITY (TRACEZ_CHUNK_SIZE + 2 * sizeof(TraceKeyframe))
+#define VARINT_CAPACITY (RAW_CAPACITY / sizeof(Word) * 5)
+#define LZ_CAPACITY (VARINT_CAPACITY + VARINT_CAPACITY / 255 + 16)
+
+/* What the next record words are predicted to be. Both sides start a chunk
+ * from zero and update it identically. */
+typedef struct {
+  Word prev[NUM_KINDS][MAX_WORDS];
+  Register R[32];
+} Predictor;
+
+static Word read32(const Byte *p) {
+  Word w;
+
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+/* Returns the size of the record at the start of record, or 0 if it is not
+ * a valid record. Delta records need at least their tag word in avail. */
+size_t tracez_record_size(TraceFormat format, const Byte *record,
+                          size_t avail) {
+  if (format == TRACE_BIN) {
+    return sizeof(TraceRetire);
+  }
+  if (avail < sizeof(Word)) {
+    return 0;
+  }
+  switch (TRACE_TAG_KIND(read32(record))) {
+  case TRACE_STEP:
+    return sizeof(TraceStep);
+  case TRACE_MEM_WRITE:
+    return sizeof(TraceMemWrite);
+  case TRACE_KEYFRAME:
+    return sizeof(TraceKeyframe);
+  default:
+    return 0;
+  }
+}
+
+/* Bytes needed before the record at rec can be processed */
+static size_t bytes_needed(TraceFormat format, const Byte *rec, size_t avail) {
+  if (format != TRACE_BIN && avail < sizeof(Word)) {
+    return sizeof(Word);
+  }
+  return tracez_record_size(format, rec, avail);
+}
+
+static Byte *put_varint(Byte *out, Word value) {
+  while (value >= 0x80) {
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
+}
+
+static const Byte *get_varint(const Byte *in, const Byte *end, Word *value) {
+  Word result = 0;
+  int shift;
+
+  for (shift = 0; in < end && shift < 35; shift += 7) {
+    Byte b = *in++;
+
+    result |= (Word)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *value = result;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+static Word zigzag(Word delta) {
+  return (delta << 1) ^ (Word)((sWord)delta >> 31);
+}
+
+static Word unzigzag(Word value) {
+  return (value >> 1) ^ -(value & 1);
+}
+
+/* The value word i of a record of the given kind is predicted to have */
+static Word *predicted(Predictor *pred, Word kind, const Word *words,
+                       size_t i) {
+  if (kind == TRACE_STEP && i == offsetof(TraceStep, value) / sizeof(Word)) {
+    return &pred->R[TRACE_TAG_ARG(words[0]) & 0x1f];
+  }
+  return &pred->prev[kind][i];
+}
+
+static void update_predictor(Predictor *pred, Word kind, const Word *words) {
+  if (kind == TRACE_KEYFRAME) {
+    memcpy(pred->R, words + offsetof(TraceKeyframe, R) / sizeof(Word),
+           sizeof(pred->R));
+  }
+}
+
+static size_t encode_records(TraceFormat format, const Byte *raw,
+                             size_t raw_len, Byte *out) {
+  Predictor pred;
+  Word words[MAX_WORDS];
+  Byte *start = out;
+  size_t pos, size, i, first;
+  Word kind;
+
+  memset(&pred, 0, sizeof(pred));
+  for (pos = 0; pos < raw_len; pos += size) {
+    size = tracez_record_size(format, raw + pos, raw_len - pos);
+    memcpy(words, raw + pos, size);
+    kind = 0;
+    first = 0;
+    if (format != TRACE_BIN) {
+      /* the tag is stored as is, it tells the decoder what follows */
+      kind = TRACE_TAG_KIND(words[0]);
+      out = put_varint(out, words[0]);
+      first = 1;
+    }
+    for (i = first; i < size / sizeof(Word); i++) {
+      Word *guess = predicted(&pred, kind, words, i);
+
+      out = put_varint(out, zigzag(words[i] - *guess));
+      *guess = words[i];
+    }
+    update_predictor(&pred, kind, words);
+  }
+  return out - start;
+}
+
+static Byte *lz_length(Byte *out, size_t len) {
+  while (len >= 255) {
+    *out++ = 255;
+    len -= 255;
+  }
+  *out++ = len;
+  return out;
+}
+
+/* Emits literal bytes followed by a match (match_len 0 for none). The token
+ * holds both lengths in four bits each, longer ones continue in bytes. */
+static Byte *lz_sequence(Byte *out, const Byte *literals, size_t literal_len,
+                         size_t offset, size_t match_len) {
+  Byte *token = out++;
+  size_t extra = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+  *token = (literal_len < 15 ? literal_len : 15) << 4 | (extra < 15 ? extra : 15);
+  if (literal_len >= 15) {
+    out = lz_length(out, literal_len - 15);
+  }
+  memcpy(out, literals, literal_len);
+  out += literal_len;
+  if (match_len) {
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+    if (extra >= 15) {
+      out = lz_length(out, extra - 15);
+    }
+  }
+  return out;
+}
+
+static size_t lz_compress(const Byte *in, size_t len, Byte *out) {
+  static Word table[1 << LZ_HASH_BITS]; /* position + 1 of each hash */
+  Byte *start = out;
+  size_t pos = 0, anchor = 0;
+
+  memset(table, 0, sizeof(table));
+  while (pos + LZ_MIN_MATCH <= len) {
+    Word sequence = read32(in + pos);
+    Word hash = (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+    size_t candidate = table[hash];
+
+    table[hash] = pos + 1;
+    if (candidate-- && pos - candidate <= LZ_MAX_OFFSET &&
+        read32(in + candidate) == sequence) {
+      size_t match_len = LZ_MIN_MATCH;
+
+      while (pos + match_len < len &&
+             in[candidate + match_len] == in[pos + match_len]) {
+        match_len++;
+      }
+      out = lz_sequence(out, in + anchor, pos - anchor, pos - candidate,
+                        match_len);
+      pos += match_len;
+      anchor = pos;
+    } else {
+      pos++;
+    }
+  }
+  return lz_sequence(out, in + anchor, len - anchor, 0, 0) - start;
+}
+
+static const Byte *lz_read_length(const Byte *in, const Byte *end,
+                                  size_t *len) {
+  Byte b;
+
+  do {
+    if (in >= end) {
+      return NULL;
+    }
+    b = *in++;
+    *len += b;
+  } while (b == 255);
+  return in;
+}
+
+/* Returns the decompressed length, or -1 if the data is corrupt */
+static long lz_decompress(const Byte *in, size_t len, Byte *out,
+                          size_t capacity) {
+  const Byte *end = in + len;
+  Byte *op = out, *op_end = out + capacity;
+
+  while (in < end) {
+    Byte token = *in++;
+    size_t literal_len = token >> 4, match_len = token & 0xf, offset;
+
+    if (literal_len == 15 && !(in = lz_read_length(in, end, &literal_len))) {
+      return -1;
+    }
+    if (literal_len > (size_t)(end - in) ||
+        literal_len > (size_t)(op_end - op)) {
+      return -1;
+    }
+    memcpy(op, in, literal_len);
+    op += literal_len;
+    in += literal_len;
+    if (in == end) {
+      break; /* the last sequence has no match */
+    }
+
+    if (end - in < 2) {
+      return -1;
+    }
+    offset = in[0] | (in[1] << 8);
+    in += 2;
+    if (match_len == 15 && !(in = lz_read_length(in, end, &match_len))) {
+      return -1;
+    }
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - out) ||
+        match_len > (size_t)(op_end - op)) {
+      return -1;
+    }
+    if (offset >= match_len) {
+      memcpy(op, op - offset, match_len);
+      op += match_len;
+    } else {
+      while (match_len--) {
+        *op = *(op - offset);
+        op++;
+      }
+    }
+  }
+  return op - out;
+}
+
+/* Expands a chunk into raw (chunk->raw_size bytes) using scratch
+ * (chunk->varint_size bytes). Returns 0 on success. */
+int tracez_decode_chunk(TraceFormat format, const TraceChunk *chunk,
+                        const Byte *data, Byte *raw, Byte *scratch) {
+  const Byte *in = scratch, *end = scratch + chunk->varint_size;
+  Byte *out = raw, *out_end = raw + chunk->raw_size;
+  Predictor pred;
+  Word words[MAX_WORDS], kind, value;
+  size_t i, first, size;
+
+  if (lz_decompress(data, chunk->size, scratch, chunk->varint_size) !=
+      (long)chunk->varint_size) {
+    return -1;
+  }
+
+  memset(&pred, 0, sizeof(pred));
+  while (out < out_end) {
+    kind = 0;
+    first = 0;
+    size = sizeof(TraceRetire);
+    if (format != TRACE_BIN) {
+      if (!(in = get_varint(in, end, &words[0]))) {
+        return -1;
+      }
+      kind = TRACE_TAG_KIND(words[0]);
+      size = tracez_record_size(format, (const Byte *)words, sizeof(Word));
+      first = 1;
+    }
+    if (size == 0 || size > (size_t)(out_end - out)) {
+      return -1;
+    }
+    for (i = first; i < size / sizeof(Word); i++) {
+      Word *guess = predicted(&pred, kind, words, i);
+
+      if (!(in = get_varint(in, end, &value))) {
+        return -1;
+      }
+      words[i] = *guess + unzigzag(value);
+      *guess = words[i];
+    }
+    update_predictor(&pred, kind, words);
+    memcpy(out, words, size);
+    out += size;
+  }
+  return in == end ? 0 : -1;
+}
+
+int tracez_init(TraceCompressor *z, TraceFormat format, TraceSink sink,
+                Double offset) {
+  memset(z, 0, sizeof(*z));
+  z->format = format;
+  z->sink = sink;
+  z->offset = offset;
+  z->raw = malloc(RAW_CAPACITY);
+  z->varint = malloc(VARINT_CAPACITY);
+  z->lz = malloc(LZ_CAPACITY);
+  if (z->raw == NULL || z->varint == NULL || z->lz == NULL) {
+    free(z->raw);
+    free(z->varint);
+    free(z->lz);
+    return -1;
+  }
+  return 0;
+}
+
+static void tracez_flush(TraceCompressor *z) {
+  TraceChunk chunk;
+
+  if (z->raw_len == 0) {
+    return;
+  }
+  if (z->index_count == z->index_size) {
+    z->index_size = z->index_size ? 2 * z->index_size : 64;
+    z->index = realloc(z->index, z->index_size * sizeof(*z->index));
+    if (z->index == NULL) {
+      fprintf(stderr, "Out of memory compressing trace\n");
+      exit(-1);
+    }
+  }
+  z->index[z->index_count].index = z->raw_first;
+  z->index[z->index_count].offset = z->offset;
+  z->index_count++;
+
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.raw_size = z->raw_len;
+  chunk.varint_size = encode_records(z->format, z->raw, z->raw_len, z->varint);
+  chunk.size = lz_compress(z->varint, chunk.varint_size, z->lz);
+  chunk.first = z->raw_first;
+  z->sink(&chunk, sizeof(chunk));
+  z->sink(z->lz, chunk.size);
+  z->offset += sizeof(chunk) + chunk.size;
+  z->raw_len = 0;
+}
+
+static void tracez_append(TraceCompressor *z, const void *data, size_t len) {
+  memcpy(z->raw + z->raw_len, data, len);
+  z->raw_len += len;
+}
+
+/* Adds one complete record to the current chunk */
+static void tracez_record(TraceCompressor *z, const Byte *record,
+                          size_t size) {
+  Word kind = z->format == TRACE_BIN ? 0 : TRACE_TAG_KIND(read32(record));
+  TraceKeyframe keyframe;
+  TraceStep step;
+
+  /* chunks are only cut in front of a step or keyframe, so a memory write
+     always stays with its step */
+  if (z->raw_len >= TRACEZ_CHUNK_SIZE && kind != TRACE_MEM_WRITE) {
+    tracez_flush(z);
+  }
+  if (z->raw_len == 0) {
+    z->raw_first = z->count;
+    if (kind == TRACE_STEP) {
+      memcpy(&step, record, sizeof(step));
+      memset(&keyframe, 0, sizeof(keyframe));
+      keyframe.tag = TRACE_TAG(TRACE_KEYFRAME, 0);
+      keyframe.index = z->count;
+      keyframe.pc = step.pc;
+      memcpy(keyframe.R, z->R, sizeof(keyframe.R));
+      tracez_append(z, &keyframe, sizeof(keyframe));
+    }
+  }
+  tracez_append(z, record, size);
+
+  switch (kind) {
+  case 0:
+    z->count++;
+    break;
+  case TRACE_STEP:
+    memcpy(&step, record, sizeof(step));
+    z->R[TRACE_TAG_ARG(step.tag) & 0x1f] = step.value;
+    z->R[0] = 0;
+    z->count++;
+    break;
+  case TRACE_KEYFRAME:
+    memcpy(&keyframe, record, sizeof(keyframe));
+    memcpy(z->R, keyframe.R, sizeof(z->R));
+    z->count = keyframe.index; /* later than count if steps were dropped */
+    break;
+  }
+}
+
+/* Compresses the next len bytes of the record stream. Records may be split
+ * across calls. */
+void tracez_write(TraceCompressor *z, const void *data, size_t len) {
+  const Byte *p = data;
+  size_t size, take;
+
+  while (len > 0) {
+    if (z->partial_len == 0) {
+      size = bytes_needed(z->format, p, len);
+      if (size != 0 && size <= len) {
+        tracez_record(z, p, size);
+        p += size;
+        len -= size;
+        continue;
+      }
+    } else {
+      size = bytes_needed(z->format, z->partial, z->partial_len);
+    }
+    if (size == 0 || size > sizeof(z->partial)) {
+      fprintf(stderr, "Corrupt trace record while compressing\n");
+      exit(-1);
+    }
+
+    take = size - z->partial_len < len ? size - z->partial_len : len;
+    memcpy(z->partial + z->partial_len, p, take);
+    z->partial_len += take;
+    p += take;
+    len -= take;
+    if (z->partial_len ==
+        bytes_needed(z->format, z->partial, z->partial_len)) {
+      tracez_record(z, z->partial, z->partial_len);
+      z->partial_len = 0;
+    }
+  }
+}
+
+/* Writes the last chunk and the chunk index */
+void tracez_finish(TraceCompressor *z) {
+  TraceIndex trailer;
+
+  tracez_flush(z);
+  trailer.count = z->index_count;
+  trailer.offset = z->offset;
+  memcpy(trailer.magic, TRACEZ_INDEX_MAGIC, sizeof(trailer.magic));
+  z->sink(z->index, z->index_count * sizeof(*z->index));
+  z->sink(&trailer, sizeof(trailer));
+
+  free(z->index);
+  free(z->raw);
+  free(z->varint);
+  free(z->lz);
+  memset(z, 0, sizeof(*z));
+}
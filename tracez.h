@@ -0,0 +1,58 @@
+#ifndef TRACEZ_H
+#define TRACEZ_H
+
+#include <stddef.h>
+#include "trace.h"
+#include "types.h"
+
+/* Streaming compression for binary and delta traces (--trace-compress).
+
+   The records after the TraceHeader are cut into independent chunks of
+   about TRACEZ_CHUNK_SIZE bytes. Inside a chunk every record word is stored
+   as a zigzag varint of its difference from the same word of the previous
+   record of the same kind (a step's new value is predicted from the
+   register it overwrites), and the varint stream is then packed by a small
+   LZ77 coder. Each chunk of a delta trace starts with a keyframe, so any
+   chunk can be decoded on its own; the chunk index at the end of the file
+   maps instruction indexes to chunks. */
+#define TRACEZ_CHUNK_SIZE (1 << 20)
+#define TRACEZ_INDEX_MAGIC "RVTRZIX\0"
+
+typedef struct {
+  Word raw_size;    /* bytes of records in the chunk */
+  Word varint_size; /* bytes of the varint stream */
+  Word size;        /* bytes of LZ data following this header */
+  Word reserved;
+  Double first;     /* index of the first instruction in the chunk */
+} TraceChunk;
+
+typedef void (*TraceSink)(const void *data, size_t len);
+
+typedef struct {
+  TraceFormat format;
+  TraceSink sink;
+  Double offset;            /* file offset of the next chunk */
+  Double count;             /* instructions seen so far */
+  Register R[32];           /* register state, for chunk keyframes */
+  Byte partial[256];        /* incomplete record carried between writes */
+  size_t partial_len;
+  Byte *raw;                /* records of the current chunk */
+  size_t raw_len;
+  Double raw_first;
+  Byte *varint;
+  Byte *lz;
+  TraceIndexEntry *index;
+  Double index_count, index_size;
+} TraceCompressor;
+
+int tracez_init(TraceCompressor *z, TraceFormat format, TraceSink sink,
+                Double offset);
+void tracez_write(TraceCompressor *z, const void *data, size_t len);
+void tracez_finish(TraceCompressor *z);
+
+size_t tracez_record_size(TraceFormat format, const Byte *record,
+                          size_t avail);
+int tracez_decode_chunk(TraceFormat format, const TraceChunk *chunk,
+                        const Byte *data, Byte *raw, Byte *scratch);
+
+#endif
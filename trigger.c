@@ -0,0 +1,57 @@
+#include "trigger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void trigger_init(TraceTrigger *trigger) {
+  memset(trigger, 0, sizeof(*trigger));
+  trigger->start_pc = TRIGGER_NONE;
+  trigger->stop_pc = TRIGGER_NONE;
+  trigger->start_index = TRIGGER_NONE;
+  trigger->stop_index = TRIGGER_NONE;
+}
+
+/* Parses FIRST[:COUNT], the instructions to trace. Returns 0 on success. */
+int trigger_parse_window(TraceTrigger *trigger, const char *arg) {
+  char *end;
+  Double count;
+
+  trigger->start_index = strtoull(arg, &end, 0);
+  if (end == arg || (*end != '\0' && *end != ':')) {
+    return -1;
+  }
+  if (*end == ':') {
+    arg = end + 1;
+    count = strtoull(arg, &end, 0);
+    if (end == arg || *end != '\0' || count == 0) {
+      return -1;
+    }
+    trigger->stop_index = trigger->start_index + count;
+  }
+  return 0;
+}
+
+/* Parses a register number such as 10 or x10. Returns 0 on success. */
+int trigger_parse_register(TraceTrigger *trigger, const char *arg) {
+  char *end;
+  long reg = strtol(arg + (arg[0] == 'x'), &end, 10);
+
+  if (*end != '\0' || reg < 1 || reg > 31) {
+    return -1;
+  }
+  trigger->start_reg = reg;
+  return 0;
+}
+
+int trigger_enabled(const TraceTrigger *trigger) {
+  return trigger->start_pc != TRIGGER_NONE ||
+         trigger->stop_pc != TRIGGER_NONE ||
+         trigger->start_index != TRIGGER_NONE ||
+         trigger->stop_index != TRIGGER_NONE || trigger->start_reg != 0;
+}
+
+/* A run is traced from its first instruction if no start condition is set */
+int trigger_starts_traced(const TraceTrigger *trigger) {
+  return trigger->start_pc == TRIGGER_NONE &&
+         trigger->start_index == TRIGGER_NONE && trigger->start_reg == 0;
+}
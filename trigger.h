@@ -0,0 +1,39 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "types.h"
+
+/* Trace triggers (--trace-start-pc, --trace-stop-pc, --trace-window and
+   --trace-start-reg). Outside a traced window the simulator runs its
+   untraced loop and only checks whether a start condition holds before
+   each instruction; inside one it traces until a stop condition holds.
+   Unused conditions hold TRIGGER_NONE, which no pc or index reaches. */
+#define TRIGGER_NONE ((Double)-1)
+
+typedef struct {
+  Double start_pc;    /* start when the pc reaches this address */
+  Double stop_pc;     /* stop when the pc reaches this address */
+  Double start_index; /* start before instruction start_index */
+  Double stop_index;  /* stop before instruction stop_index */
+  int start_reg;      /* start when this register changes, 0 for none */
+  Register reg_value; /* its value when the untraced loop was entered */
+} TraceTrigger;
+
+void trigger_init(TraceTrigger *trigger);
+int trigger_parse_window(TraceTrigger *trigger, const char *arg);
+int trigger_parse_register(TraceTrigger *trigger, const char *arg);
+int trigger_enabled(const TraceTrigger *trigger);
+int trigger_starts_traced(const TraceTrigger *trigger);
+
+static inline int trigger_start(const TraceTrigger *trigger,
+                                const Processor *processor, Double index) {
+  return processor->PC == trigger->start_pc || index == trigger->start_index ||
+         processor->R[trigger->start_reg] != trigger->reg_value;
+}
+
+static inline int trigger_stop(const TraceTrigger *trigger,
+                               const Processor *processor, Double index) {
+  return processor->PC == trigger->stop_pc || index == trigger->stop_index;
+}
+
+#endif
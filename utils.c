@@ -1,6 +1,8 @@
 #include "utils.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 /* Sign extends the given field to a 32-bit integer where field is
  * interpreted an n-bit integer. */
@@ -52,6 +54,8 @@ Instruction parse_instruction(uint32_t instruction_bits)
   case 0x73:
   case 0x13:
   case 0x03:
+  case 0x67:
+  case 0x0F:
  // printf("I TYPE\n");
     instruction.itype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
@@ -101,6 +105,7 @@ Instruction parse_instruction(uint32_t instruction_bits)
 
   // case for U-type
   case 0x37:
+  case 0x17:
     instruction.utype.rd = instruction_bits & ((1U << 5) -1);
     instruction_bits >>= 5;
 
@@ -122,6 +127,29 @@ Instruction parse_instruction(uint32_t instruction_bits)
   return instruction;
 }
 
+/* Returns 1 if parse_instruction() can unpack instructions with the given
+ * opcode (it exits on any other opcode) */
+int is_known_opcode(unsigned int opcode)
+{
+  switch (opcode)
+  {
+  case 0x33:
+  case 0x73:
+  case 0x13:
+  case 0x03:
+  case 0x23:
+  case 0x63:
+  case 0x37:
+  case 0x17:
+  case 0x6F:
+  case 0x67:
+  case 0x0F:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 /* Return the number of bytes (from the current PC) to the branch label using
  * the given branch instruction */
 int get_branch_offset(Instruction instruction)
@@ -188,3 +216,27 @@ void handle_invalid_write(Address address)
   printf("Bad Write. Address: 0x%08x\n", address);
   exit(-1);
 }
+
+/* Writes all len bytes of buf to fd, retrying short writes. Returns 0 on
+ * success and -1 on error. */
+int write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = buf;
+
+  while (len > 0)
+  {
+    ssize_t n = write(fd, p, len);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "types.h"
 
 #define RTYPE_FORMAT "%s\tx%d, x%d, x%d\n"
@@ -5,14 +6,22 @@
 #define MEM_FORMAT "%s\tx%d, %d(x%d)\n"
 #define LUI_FORMAT "lui\tx%d, %d\n"
 #define JAL_FORMAT "jal\tx%d, %d\n"
+#define AUIPC_FORMAT "auipc\tx%d, %d\n"
+#define FENCE_FORMAT "fence\n"
+#define FENCE_I_FORMAT "fence.i\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
+#define CSR_FORMAT "%s\tx%d, %s, x%d\n"
+#define CSRI_FORMAT "%s\tx%d, %s, %d\n"
+#define CSR_READ_FORMAT "%s\tx%d\n"
 
 int sign_extend_number(unsigned, unsigned);
 Instruction parse_instruction(uint32_t);
+int is_known_opcode(unsigned int);
 int get_branch_offset(Instruction);
 int get_jump_offset(Instruction);
 int get_store_offset(Instruction);
 void handle_invalid_instruction(Instruction);
 void handle_invalid_read(Address);
 void handle_invalid_write(Address);
+int write_all(int, const void *, size_t);